@@ -0,0 +1,106 @@
+/*
+// Header file for the Parallel System Architectures Lab Session.
+// Contains the binary reader/writer used for checkpoints of the simulator
+// state and the interface that simulator components implement to take part
+// in a checkpoint. Values are stored in host byte order, so checkpoints are
+// only meant to be restored on the machine type that created them.
+*/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <stdint.h>
+
+class CheckpointWriter {
+    public:
+    CheckpointWriter(const char *filename)
+    : m_output(filename, std::ios::out | std::ios::binary | std::ios::trunc) {
+        if (!m_output.is_open()) {
+            throw std::runtime_error(std::string("Unable to create checkpoint: ") + filename);
+        }
+    }
+
+    void write_bytes(const void *data, size_t size) {
+        m_output.write((const char *)data, size);
+        if (m_output.fail()) {
+            throw std::runtime_error("Unable to write checkpoint");
+        }
+    }
+
+    template <typename T>
+    void write(const T &value) {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "Only plain values can be written directly");
+        write_bytes(&value, sizeof(T));
+    }
+
+    void write_string(const std::string &s) {
+        write((uint32_t)s.size());
+        write_bytes(s.data(), s.size());
+    }
+
+    private:
+    std::ofstream m_output;
+};
+
+class CheckpointReader {
+    public:
+    CheckpointReader(const char *filename)
+    : m_input(filename, std::ios::in | std::ios::binary) {
+        if (!m_input.is_open()) {
+            throw std::runtime_error(std::string("Unable to open checkpoint: ") + filename);
+        }
+    }
+
+    void read_bytes(void *data, size_t size) {
+        m_input.read((char *)data, size);
+        if (m_input.fail()) {
+            throw std::runtime_error("Unexpected end of checkpoint");
+        }
+    }
+
+    template <typename T>
+    T read() {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "Only plain values can be read directly");
+        T value;
+        read_bytes(&value, sizeof(T));
+        return value;
+    }
+
+    std::string read_string() {
+        std::string s(read<uint32_t>(), '\0');
+        read_bytes(&s[0], s.size());
+        return s;
+    }
+
+    // Reads a value and throws if it differs from what the current
+    // simulator configuration expects.
+    template <typename T>
+    void expect(const T &expected, const char *what) {
+        if (read<T>() != expected) {
+            throw std::runtime_error(std::string("Checkpoint does not match ") + what);
+        }
+    }
+
+    private:
+    std::ifstream m_input;
+};
+
+// Interface for components whose state is stored in a checkpoint. Components
+// are only saved and restored while they are idle between two accesses.
+class Checkpointable {
+    public:
+    virtual ~Checkpointable() {}
+    virtual const char *checkpoint_name() const = 0;
+    virtual void save(CheckpointWriter &out) const = 0;
+    virtual void restore(CheckpointReader &in) = 0;
+};
+
+#endif
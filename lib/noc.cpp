@@ -0,0 +1,369 @@
+/*
+ * File: noc.cpp
+ *
+ * Implementation of the 2D mesh network-on-chip model, see noc.h.
+ */
+
+#include "noc.h"
+
+#include <iomanip>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+void noc_parse_mesh(const char *arg, NocConfig &config) {
+    string s(arg);
+    size_t x = s.find('x');
+    if (x == string::npos) {
+        throw runtime_error("Error, mesh size must be given as WxH");
+    }
+    config.width = stoul(s.substr(0, x));
+    config.height = stoul(s.substr(x + 1));
+}
+
+Mesh::Mesh(const NocConfig &config)
+: m_config(config), m_routers(nodes()), m_sources(nodes()),
+  m_delivered_packets(nodes()) {
+    if (config.width == 0 || config.height == 0 || config.vcs == 0 ||
+        config.buffer_depth == 0 || config.link_width == 0 ||
+        config.link_latency == 0) {
+        throw runtime_error("Error, invalid network configuration");
+    }
+    for (Router &r : m_routers) {
+        for (unsigned p = 0; p < PORTS; p++) {
+            r.in[p].vcs.resize(config.vcs);
+            r.out[p].credits.assign(config.vcs, config.buffer_depth);
+            r.out[p].busy.assign(config.vcs, false);
+        }
+    }
+}
+
+unsigned Mesh::flits_for(unsigned bytes) const {
+    unsigned flits = (bytes + m_config.link_width - 1) / m_config.link_width;
+    return flits ? flits : 1;
+}
+
+void Mesh::inject(Packet p) {
+    p.id = m_next_id++;
+    p.created = m_cycle;
+    if (p.src >= nodes() || p.dst >= nodes()) {
+        throw runtime_error("Error, packet for a node outside the mesh");
+    }
+    if (measured(p.created)) {
+        m_measured_in_flight++;
+        m_offered_flits += p.flits;
+    }
+    m_sources[p.src].queue.push_back(p);
+}
+
+bool Mesh::eject(unsigned node, Packet &p) {
+    if (m_delivered_packets[node].empty()) {
+        return false;
+    }
+    p = m_delivered_packets[node].front();
+    m_delivered_packets[node].pop_front();
+    return true;
+}
+
+void Mesh::set_measure_window(uint64_t start, uint64_t end) {
+    m_window_start = start;
+    m_window_end = end;
+}
+
+unsigned Mesh::neighbor(unsigned node, unsigned port) const {
+    switch (port) {
+    case PORT_NORTH: return node - m_config.width;
+    case PORT_SOUTH: return node + m_config.width;
+    case PORT_EAST: return node + 1;
+    case PORT_WEST: return node - 1;
+    default: return node;
+    }
+}
+
+bool Mesh::has_neighbor(unsigned node, unsigned port) const {
+    switch (port) {
+    case PORT_NORTH: return y_of(node) > 0;
+    case PORT_SOUTH: return y_of(node) + 1 < m_config.height;
+    case PORT_EAST: return x_of(node) + 1 < m_config.width;
+    case PORT_WEST: return x_of(node) > 0;
+    default: return true; // the local port
+    }
+}
+
+unsigned Mesh::opposite(unsigned port) {
+    switch (port) {
+    case PORT_NORTH: return PORT_SOUTH;
+    case PORT_SOUTH: return PORT_NORTH;
+    case PORT_EAST: return PORT_WEST;
+    case PORT_WEST: return PORT_EAST;
+    default: return PORT_LOCAL;
+    }
+}
+
+// Dimension-order routing: first along X, then along Y. Deadlock free on a
+// mesh because no packet turns from the Y into the X dimension.
+unsigned Mesh::route(unsigned node, unsigned dst) const {
+    if (x_of(dst) > x_of(node)) return PORT_EAST;
+    if (x_of(dst) < x_of(node)) return PORT_WEST;
+    if (y_of(dst) > y_of(node)) return PORT_SOUTH;
+    if (y_of(dst) < y_of(node)) return PORT_NORTH;
+    return PORT_LOCAL;
+}
+
+void Mesh::step() {
+    arrive();
+    for (unsigned node = 0; node < nodes(); node++) {
+        inject_flits(node);
+    }
+    for (unsigned node = 0; node < nodes(); node++) {
+        allocate_vcs(node);
+        traverse(node);
+    }
+    m_cycle++;
+}
+
+// Moves the flits and credits that reached the end of their link.
+void Mesh::arrive() {
+    while (!m_links.empty() && m_links.front().arrival <= m_cycle) {
+        InFlight &f = m_links.front();
+        m_routers[f.router].in[f.port].vcs[f.vc].buffer.push_back(f.flit);
+        m_links.pop_front();
+    }
+    while (!m_credits.empty() && m_credits.front().arrival <= m_cycle) {
+        Credit &c = m_credits.front();
+        m_routers[c.router].out[c.port].credits[c.vc]++;
+        m_credits.pop_front();
+    }
+}
+
+// The network interface sends one flit per cycle into a free virtual
+// channel of the local input port.
+void Mesh::inject_flits(unsigned node) {
+    Source &s = m_sources[node];
+    if (s.queue.empty()) {
+        return;
+    }
+    InputPort &in = m_routers[node].in[PORT_LOCAL];
+    if (s.vc < 0) {
+        for (unsigned vc = 0; vc < m_config.vcs; vc++) {
+            if (in.vcs[vc].buffer.empty() && in.vcs[vc].out_port < 0) {
+                s.vc = vc;
+                break;
+            }
+        }
+        if (s.vc < 0) {
+            return;
+        }
+        m_packets[s.queue.front().id] = s.queue.front();
+    }
+    VirtualChannel &vc = in.vcs[s.vc];
+    if (vc.buffer.size() >= m_config.buffer_depth) {
+        return;
+    }
+    const Packet &p = s.queue.front();
+    Flit f = {p.id, s.sent == 0, s.sent + 1 == p.flits,
+              m_cycle + m_config.router_latency};
+    vc.buffer.push_back(f);
+    if (in_window()) {
+        s.flits++;
+    }
+    if (++s.sent == p.flits) {
+        s.queue.pop_front();
+        s.sent = 0;
+        s.vc = -1;
+    }
+}
+
+// Routes the packets at the front of the input VCs and gives them a free
+// virtual channel of the next router.
+void Mesh::allocate_vcs(unsigned node) {
+    Router &r = m_routers[node];
+    for (unsigned p = 0; p < PORTS; p++) {
+        for (VirtualChannel &vc : r.in[p].vcs) {
+            if (vc.buffer.empty() || vc.out_port >= 0 || !vc.buffer.front().head) {
+                continue;
+            }
+            unsigned out = route(node, m_packets[vc.buffer.front().packet].dst);
+            if (out == PORT_LOCAL) {
+                // Ejection sinks every flit, no downstream VC needed
+                vc.out_port = out;
+                vc.out_vc = 0;
+                continue;
+            }
+            OutputPort &o = r.out[out];
+            for (unsigned i = 0; i < m_config.vcs; i++) {
+                unsigned v = (o.vc_rr + i) % m_config.vcs;
+                if (!o.busy[v]) {
+                    o.busy[v] = true;
+                    o.vc_rr = v + 1;
+                    vc.out_port = out;
+                    vc.out_vc = v;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// Switch allocation and traversal: every output port takes at most one flit
+// per cycle, and every input port sends at most one.
+void Mesh::traverse(unsigned node) {
+    Router &r = m_routers[node];
+    bool input_used[PORTS] = {};
+    unsigned candidates = PORTS * m_config.vcs;
+
+    for (unsigned out = 0; out < PORTS; out++) {
+        OutputPort &o = r.out[out];
+        for (unsigned i = 0; i < candidates; i++) {
+            unsigned c = (r.sa_rr[out] + i) % candidates;
+            unsigned p = c / m_config.vcs;
+            VirtualChannel &vc = r.in[p].vcs[c % m_config.vcs];
+            if (input_used[p] || vc.buffer.empty() || vc.out_port != (int)out ||
+                vc.buffer.front().ready > m_cycle) {
+                continue;
+            }
+            if (out != PORT_LOCAL && o.credits[vc.out_vc] == 0) {
+                continue;
+            }
+
+            input_used[p] = true;
+            r.sa_rr[out] = c + 1;
+            Flit f = vc.buffer.front();
+            vc.buffer.pop_front();
+
+            if (p != PORT_LOCAL) {
+                // Return the freed buffer slot to the upstream router
+                m_credits.push_back({neighbor(node, p), opposite(p),
+                                     (unsigned)(c % m_config.vcs),
+                                     m_cycle + m_config.link_latency});
+            }
+            if (in_window()) {
+                o.flits++;
+            }
+
+            if (out == PORT_LOCAL) {
+                deliver(node, f);
+            } else {
+                o.credits[vc.out_vc]--;
+                uint64_t arrival = m_cycle + m_config.link_latency;
+                f.ready = arrival + m_config.router_latency;
+                m_links.push_back({neighbor(node, out), opposite(out),
+                                   (unsigned)vc.out_vc, arrival, f});
+                if (f.tail) {
+                    o.busy[vc.out_vc] = false;
+                }
+            }
+            if (f.tail) {
+                vc.out_port = -1;
+                vc.out_vc = -1;
+            }
+            break;
+        }
+    }
+}
+
+void Mesh::deliver(unsigned node, const Flit &flit) {
+    if (in_window()) {
+        m_accepted_flits++;
+    }
+    if (!flit.tail) {
+        return;
+    }
+    auto it = m_packets.find(flit.packet);
+    Packet p = it->second;
+    m_packets.erase(it);
+
+    if (measured(p.created)) {
+        uint64_t latency = m_cycle + 1 - p.created;
+        m_measured_in_flight--;
+        m_delivered++;
+        m_latency_sum += latency;
+        if (latency >= m_latencies.size()) {
+            m_latencies.resize(latency + 1);
+        }
+        m_latencies[latency]++;
+    }
+    m_delivered_packets[node].push_back(p);
+}
+
+uint64_t Mesh::window_cycles() const {
+    uint64_t end = min(m_cycle, m_window_end);
+    return end > m_window_start ? end - m_window_start : 0;
+}
+
+double Mesh::average_latency() const {
+    return m_delivered ? (double)m_latency_sum / m_delivered : 0.0;
+}
+
+uint64_t Mesh::latency_percentile(double p) const {
+    uint64_t target = (uint64_t)(p * m_delivered);
+    uint64_t seen = 0;
+    for (size_t l = 0; l < m_latencies.size(); l++) {
+        seen += m_latencies[l];
+        if (seen > target) {
+            return l;
+        }
+    }
+    return m_latencies.empty() ? 0 : m_latencies.size() - 1;
+}
+
+double Mesh::offered_throughput() const {
+    uint64_t cycles = window_cycles();
+    return cycles ? (double)m_offered_flits / nodes() / cycles : 0.0;
+}
+
+double Mesh::accepted_throughput() const {
+    uint64_t cycles = window_cycles();
+    return cycles ? (double)m_accepted_flits / nodes() / cycles : 0.0;
+}
+
+void Mesh::print_stats(ostream &out) const {
+    uint64_t cycles = window_cycles();
+    out << "Network (" << m_config.width << "x" << m_config.height << " mesh, "
+        << m_config.vcs << " VCs of " << m_config.buffer_depth << " flits, "
+        << m_config.link_width << " byte links, link latency "
+        << m_config.link_latency << ", router latency "
+        << m_config.router_latency << "):" << endl;
+    out << "  Packets: " << m_delivered << " delivered, average latency "
+        << setprecision(4) << average_latency() << " cycles, p50 "
+        << latency_percentile(0.5) << ", p95 " << latency_percentile(0.95)
+        << ", p99 " << latency_percentile(0.99) << ", max "
+        << (m_latencies.empty() ? 0 : m_latencies.size() - 1) << endl;
+    out << "  Throughput: offered " << offered_throughput() << ", accepted "
+        << accepted_throughput() << " flits/node/cycle" << endl;
+
+    out << "  Latency distribution (cycles):" << endl;
+    for (uint64_t low = 1; low < m_latencies.size(); low *= 2) {
+        uint64_t n = 0;
+        for (uint64_t l = low; l < min<uint64_t>(2 * low, m_latencies.size()); l++) {
+            n += m_latencies[l];
+        }
+        if (n) {
+            out << "    " << setw(6) << low << " - " << setw(6) << 2 * low - 1
+                << ": " << setw(9) << n << " (" << setprecision(3)
+                << 100.0 * n / m_delivered << "%)" << endl;
+        }
+    }
+
+    static const char *names[] = {"Local", "North", "East", "South", "West"};
+    out << "  Link utilization (flits/cycle), per router output:" << endl;
+    out << "    " << setw(8) << "Router";
+    for (unsigned p = 0; p < PORTS; p++) {
+        out << setw(8) << names[p];
+    }
+    out << setw(8) << "Inject" << endl;
+    for (unsigned node = 0; node < nodes(); node++) {
+        string pos = "(" + to_string(x_of(node)) + "," + to_string(y_of(node)) + ")";
+        out << "    " << setw(8) << pos << fixed << setprecision(3);
+        for (unsigned p = 0; p < PORTS; p++) {
+            if (has_neighbor(node, p)) {
+                out << setw(8) << (cycles ? (double)m_routers[node].out[p].flits / cycles : 0.0);
+            } else {
+                out << setw(8) << "-";
+            }
+        }
+        out << setw(8) << (cycles ? (double)m_sources[node].flits / cycles : 0.0)
+            << defaultfloat << endl;
+    }
+}
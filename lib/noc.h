@@ -0,0 +1,180 @@
+/*
+ * File: noc.h
+ *
+ * Cycle-level model of a 2D mesh network-on-chip. Every node has a router
+ * with five ports (local, north, east, south, west), input buffered virtual
+ * channels, dimension-order (XY) routing, credit-based flow control and
+ * round-robin virtual-channel and switch allocation. Packets are split into
+ * flits of the link width and delivered to the destination node once their
+ * tail flit is ejected.
+ *
+ * The model is plain C++ and is advanced with step(), once per clock cycle.
+ * It is used by the multi-core mode of assignment_1 to connect the per-core
+ * caches to the LLC banks, and by noc_sim with synthetic traffic.
+ */
+
+#ifndef NOC_H
+#define NOC_H
+
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+struct NocConfig {
+    unsigned width = 2;
+    unsigned height = 2;
+    unsigned vcs = 2;            // virtual channels per input port
+    unsigned buffer_depth = 4;   // flits per virtual channel
+    unsigned link_latency = 1;   // cycles to cross a link
+    unsigned link_width = 16;    // bytes per flit
+    unsigned router_latency = 1; // cycles from entering a router to leaving it
+};
+
+// Parses a "WxH" mesh size, throws on bad input.
+void noc_parse_mesh(const char *arg, NocConfig &config);
+
+struct Packet {
+    uint64_t id = 0;
+    unsigned src = 0;
+    unsigned dst = 0;
+    unsigned flits = 1;
+    uint64_t created = 0; // cycle the packet was handed to the network
+
+    // Contents, not interpreted by the network
+    uint32_t kind = 0;
+    uint64_t addr = 0;
+    uint32_t data = 0;
+};
+
+class Mesh {
+    public:
+    explicit Mesh(const NocConfig &config);
+
+    const NocConfig &config() const { return m_config; }
+    unsigned nodes() const { return m_config.width * m_config.height; }
+    uint64_t cycle() const { return m_cycle; }
+
+    // Number of flits needed for a packet of given size in bytes
+    unsigned flits_for(unsigned bytes) const;
+
+    // Queues a packet at its source node. Sets its id and creation time.
+    void inject(Packet p);
+
+    // Takes the next packet delivered at node, if any.
+    bool eject(unsigned node, Packet &p);
+
+    // Advances the network by one cycle.
+    void step();
+
+    // Packets created in [start, end) are measured. Link utilization and
+    // accepted throughput are counted over the cycles in that window.
+    void set_measure_window(uint64_t start, uint64_t end);
+
+    // Measured packets that were not delivered yet
+    uint64_t measured_in_flight() const { return m_measured_in_flight; }
+
+    // Results over the measurement window
+    uint64_t packets_delivered() const { return m_delivered; }
+    double average_latency() const;
+    uint64_t latency_percentile(double p) const;
+    double offered_throughput() const;  // flits per node per cycle
+    double accepted_throughput() const; // flits per node per cycle
+
+    void print_stats(std::ostream &out) const;
+
+    private:
+    enum Port { PORT_LOCAL, PORT_NORTH, PORT_EAST, PORT_SOUTH, PORT_WEST, PORTS };
+
+    struct Flit {
+        uint64_t packet;
+        bool head;
+        bool tail;
+        uint64_t ready; // first cycle it may leave the router
+    };
+
+    struct VirtualChannel {
+        std::deque<Flit> buffer;
+        int out_port = -1; // route of the packet at the front, -1 if none
+        int out_vc = -1;
+    };
+
+    struct InputPort {
+        std::vector<VirtualChannel> vcs;
+    };
+
+    struct OutputPort {
+        std::vector<unsigned> credits; // free buffer slots downstream, per VC
+        std::vector<bool> busy;        // downstream VC held by a packet
+        unsigned vc_rr = 0;
+        uint64_t flits = 0;            // flits sent in the window
+    };
+
+    struct Router {
+        InputPort in[PORTS];
+        OutputPort out[PORTS];
+        unsigned sa_rr[PORTS] = {}; // switch allocation priority per output
+    };
+
+    struct Source {
+        std::deque<Packet> queue;
+        unsigned sent = 0; // flits of the front packet already injected
+        int vc = -1;
+        uint64_t flits = 0;
+    };
+
+    struct InFlight {
+        unsigned router, port, vc;
+        uint64_t arrival;
+        Flit flit;
+    };
+
+    struct Credit {
+        unsigned router, port, vc;
+        uint64_t arrival;
+    };
+
+    NocConfig m_config;
+    uint64_t m_cycle = 0;
+    uint64_t m_next_id = 0;
+    std::vector<Router> m_routers;
+    std::vector<Source> m_sources;
+    std::vector<std::deque<Packet>> m_delivered_packets;
+    std::unordered_map<uint64_t, Packet> m_packets;
+    std::deque<InFlight> m_links;
+    std::deque<Credit> m_credits;
+
+    // Measurement
+    uint64_t m_window_start = 0;
+    uint64_t m_window_end = UINT64_MAX;
+    uint64_t m_measured_in_flight = 0;
+    uint64_t m_delivered = 0;
+    uint64_t m_latency_sum = 0;
+    std::vector<uint64_t> m_latencies; // histogram, one bucket per cycle
+    uint64_t m_offered_flits = 0;
+    uint64_t m_accepted_flits = 0;
+
+    bool measured(uint64_t created) const {
+        return created >= m_window_start && created < m_window_end;
+    }
+    bool in_window() const {
+        return m_cycle >= m_window_start && m_cycle < m_window_end;
+    }
+    uint64_t window_cycles() const;
+
+    unsigned x_of(unsigned node) const { return node % m_config.width; }
+    unsigned y_of(unsigned node) const { return node / m_config.width; }
+    unsigned neighbor(unsigned node, unsigned port) const;
+    bool has_neighbor(unsigned node, unsigned port) const;
+    static unsigned opposite(unsigned port);
+    unsigned route(unsigned node, unsigned dst) const;
+
+    void arrive();
+    void inject_flits(unsigned node);
+    void allocate_vcs(unsigned node);
+    void traverse(unsigned node);
+    void deliver(unsigned node, const Flit &flit);
+};
+
+#endif
@@ -66,6 +66,9 @@ struct stats {
 const char *float_64_bit_wire = "ZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZ";
 
 static stats *stats_percpu = NULL;
+static bool stats_enabled = true;
+// Simulated time that passed before the checkpoint this run started from
+static sc_time time_offset = SC_ZERO_TIME;
 TraceFile *tracefile_ptr = NULL;
 uint32_t num_cpus = 0;
 
@@ -82,8 +85,10 @@ void init_tracefile(int *argc, char **argv[]) {
         // Get the number of CPU's from the tracefile
         num_cpus = tracefile_ptr->get_proc_count();
 
-        // Reset arguments to the next set
-        *argv = &((*argv)[2]);
+        // Reset arguments to the next set, keeping the program name in
+        // argv[0] so getopt() can be used on the remaining arguments
+        (*argv)[1] = (*argv)[0];
+        *argv = &((*argv)[1]);
         (*argc)--;
     }
 }
@@ -142,36 +147,117 @@ void stats_print() {
             rhitrate << setw(w) << whitrate << setw(w) << hitrate << endl;
     }
 
-    cout << "Total simulation time: " << sc_time_stamp() << endl;
+    cout << "Total simulation time: " << simulation_time() << endl;
 
 }
 
+void stats_set_enabled(bool enabled) {
+    stats_enabled = enabled;
+}
+
+bool stats_get_enabled() {
+    return stats_enabled;
+}
+
+uint64_t stats_hits(uint32_t cpuid) {
+    if (cpuid >= num_cpus || stats_percpu == NULL) {
+        return 0;
+    }
+    return stats_percpu[cpuid].readhit + stats_percpu[cpuid].writehit;
+}
+
+uint64_t stats_accesses(uint32_t cpuid) {
+    if (cpuid >= num_cpus || stats_percpu == NULL) {
+        return 0;
+    }
+    return stats_hits(cpuid) + stats_percpu[cpuid].readmiss +
+           stats_percpu[cpuid].writemiss;
+}
+
 void stats_writehit(uint32_t cpuid) {
-    if (cpuid < num_cpus && stats_percpu != NULL) {
+    if (cpuid < num_cpus && stats_percpu != NULL && stats_enabled) {
         stats_percpu[cpuid].writehit++;
     }
 }
 
 void stats_writemiss(uint32_t cpuid) {
-    if (cpuid < num_cpus && stats_percpu != NULL) {
+    if (cpuid < num_cpus && stats_percpu != NULL && stats_enabled) {
         stats_percpu[cpuid].writemiss++;
     }
 }
 
 void stats_readhit(uint32_t cpuid) {
-    if (cpuid < num_cpus && stats_percpu != NULL) {
+    if (cpuid < num_cpus && stats_percpu != NULL && stats_enabled) {
         stats_percpu[cpuid].readhit++;
     }
 }
 
 void stats_readmiss(uint32_t cpuid) {
-    if (cpuid < num_cpus && stats_percpu != NULL) {
+    if (cpuid < num_cpus && stats_percpu != NULL && stats_enabled) {
         stats_percpu[cpuid].readmiss++;
     }
 }
 
+sc_time simulation_time() {
+    return time_offset + sc_time_stamp();
+}
+
+// Checkpoint file signature and format version
+static const char checkpoint_signature[4] = {'5', 'C', 'K', 'P'};
+static const uint32_t checkpoint_version = 3;
+
+void checkpoint_save(const char *filename,
+                     const vector<Checkpointable *> &components) {
+    if (tracefile_ptr == NULL || stats_percpu == NULL) {
+        throw runtime_error("Error, checkpoint needs a tracefile and statistics");
+    }
+    CheckpointWriter out(filename);
+
+    out.write_bytes(checkpoint_signature, sizeof(checkpoint_signature));
+    out.write(checkpoint_version);
+    out.write(num_cpus);
+    out.write((uint64_t)simulation_time().value());
+
+    tracefile_ptr->save(out);
+    out.write_bytes(stats_percpu, sizeof(stats) * num_cpus);
+
+    out.write((uint32_t)components.size());
+    for (const Checkpointable *c : components) {
+        out.write_string(c->checkpoint_name());
+        c->save(out);
+    }
+}
+
+void checkpoint_restore(const char *filename,
+                        const vector<Checkpointable *> &components) {
+    if (tracefile_ptr == NULL || stats_percpu == NULL) {
+        throw runtime_error("Error, checkpoint needs a tracefile and statistics");
+    }
+    CheckpointReader in(filename);
+
+    char signature[4];
+    in.read_bytes(signature, sizeof(signature));
+    if (strncmp(signature, checkpoint_signature, sizeof(signature))) {
+        throw runtime_error(string("Invalid checkpoint signature in file: ") + filename);
+    }
+    in.expect(checkpoint_version, "the checkpoint format version");
+    in.expect(num_cpus, "the number of CPUs of the tracefile");
+    time_offset = sc_time::from_value(in.read<uint64_t>());
+
+    tracefile_ptr->restore(in);
+    in.read_bytes(stats_percpu, sizeof(stats) * num_cpus);
+
+    in.expect((uint32_t)components.size(), "the simulator configuration");
+    for (Checkpointable *c : components) {
+        if (in.read_string() != c->checkpoint_name()) {
+            throw runtime_error(string("Checkpoint has no state for ") + c->checkpoint_name());
+        }
+        c->restore(in);
+    }
+}
+
 TraceFile::TraceFile(const char *filename)
-: m_input(filename, ios::in | ios::binary), m_num_finished(0) {
+: m_input(filename, ios::in | ios::binary), m_num_finished(0), m_arrived(0) {
     // Check if the file properly opened
     if (!m_input.is_open() || !m_input.good()) {
         throw runtime_error(string("Unable to open file: ") + filename);
@@ -198,8 +284,11 @@ TraceFile::TraceFile(const char *filename)
     m_positions.resize(procs_count);
     streampos start = m_input.tellg();
 
-    // Setup the waiting vector for barrier events.
-    m_waiting.resize(procs_count, false);
+    // Setup the lock and barrier state of every processor.
+    m_sync.resize(procs_count);
+
+    // Read-ahead buffers start out empty
+    m_buffers.resize(procs_count);
 
     // And in the meanwhile store the end position of the file
     m_input.seekg(0, ios::end);
@@ -219,12 +308,129 @@ TraceFile::~TraceFile() {}
 void TraceFile::close() {
     m_input.close();
     m_positions.resize(0);
+    m_buffers.resize(0);
 }
 
 uint32_t TraceFile::get_proc_count() const {
     return m_positions.size();
 }
 
+void TraceFile::save(CheckpointWriter &out) const {
+    // The file size identifies the tracefile the positions belong to
+    out.write((int64_t)m_endstream);
+    for (uint32_t i = 0; i < get_proc_count(); i++) {
+        out.write((int64_t)m_positions[i]);
+        const SyncState &s = m_sync[i];
+        out.write(s.barrier);
+        out.write(s.barrier_addr);
+        out.write((uint8_t)s.releasing);
+        out.write(s.lock_addr);
+    }
+    out.write(m_num_finished);
+    out.write(m_arrived);
+    out.write((uint64_t)m_locks.size());
+    for (const auto &lock : m_locks) {
+        out.write(lock.first);
+        out.write(lock.second);
+    }
+}
+
+void TraceFile::restore(CheckpointReader &in) {
+    in.expect((int64_t)m_endstream, "the size of the tracefile");
+    for (uint32_t i = 0; i < get_proc_count(); i++) {
+        m_positions[i] = (streamoff)in.read<int64_t>();
+        SyncState &s = m_sync[i];
+        s.barrier = in.read<uint8_t>();
+        s.barrier_addr = in.read<uint64_t>();
+        s.releasing = in.read<uint8_t>();
+        s.lock_addr = in.read<uint64_t>();
+    }
+    m_num_finished = in.read<uint32_t>();
+    m_arrived = in.read<uint32_t>();
+    m_locks.clear();
+    for (uint64_t n = in.read<uint64_t>(); n > 0; n--) {
+        uint64_t addr = in.read<uint64_t>();
+        m_locks[addr] = in.read<uint32_t>();
+    }
+}
+
+/*
+ * Returns the entry at the current position of processor pid in host byte
+ * order. Entries are served from a read-ahead buffer per processor, so the
+ * file is read in large blocks instead of one entry at a time.
+ */
+uint64_t TraceFile::read_entry(uint32_t pid) {
+    ReadBuffer &buf = m_buffers[pid];
+    streampos pos = m_positions[pid];
+
+    if (pos < buf.start || pos + (streamoff)entry_size > buf.start + (streamoff)buf.size) {
+        size_t size = std::min((streamoff)buffer_size, (streamoff)(m_endstream - pos));
+        buf.data.resize(buffer_size);
+        m_input.clear();
+        m_input.seekg(pos);
+        m_input.read(buf.data.data(), size);
+        if (m_input.fail()) {
+            throw runtime_error("Unable to read file");
+        }
+        buf.start = pos;
+        buf.size = size;
+    }
+
+    uint64_t data;
+    memcpy(&data, &buf.data[pos - buf.start], sizeof(data));
+
+    // Transform data into host byte order.
+    return ntohll(data);
+}
+
+bool TraceFile::next_raw(uint32_t pid, Entry &e) {
+    if (pid >= get_proc_count() || m_positions[pid] == (streampos)0) {
+        return false;
+    }
+
+    // An incomplete last entry ends the trace like an end tag
+    if (m_positions[pid] > (m_endstream - (streampos)entry_size)) {
+        m_positions[pid] = 0;
+        m_num_finished++;
+        return false;
+    }
+
+    uint64_t data = read_entry(pid);
+    m_positions[pid] += get_proc_count() * entry_size;
+
+    e.addr = data & ~(0b111LL << 61);
+    e.type = (EntryType)(data >> 61);
+    e.waiting = false;
+
+    if (e.type == ENTRY_TYPE_END) {
+        m_positions[pid] = 0;
+        m_num_finished++;
+        return false;
+    }
+    return true;
+}
+
+void TraceFile::sync_done(uint32_t pid) {
+    SyncState &s = m_sync[pid];
+    if (s.releasing) {
+        auto lock = m_locks.find(s.lock_addr);
+        if (lock != m_locks.end() && lock->second == pid) {
+            m_locks.erase(lock);
+        }
+        s.releasing = false;
+    }
+    if (s.barrier == BARRIER_OPENING) {
+        // The waiting processors do one more read, which sees it open
+        for (SyncState &other : m_sync) {
+            if (other.barrier == BARRIER_WAITING) {
+                other.barrier = BARRIER_OPEN;
+            }
+        }
+        s.barrier = BARRIER_NONE;
+        m_arrived = 0;
+    }
+}
+
 /* No need for locking, systemc is not multithreaded. */
 bool TraceFile::next(uint32_t pid, Entry &e) {
     uint32_t cpucount = get_proc_count();
@@ -236,6 +442,11 @@ bool TraceFile::next(uint32_t pid, Entry &e) {
 
     uint64_t data;
     assert(sizeof(data) == entry_size);
+    e.waiting = false;
+
+    // The previous entry of this processor completed, so other processors
+    // can now see its lock release or barrier arrival.
+    sync_done(pid);
 
     // If trace position is no longer valid this trace has ended, return NOP.
     if (m_positions[pid] == (streampos)0) {
@@ -255,22 +466,21 @@ bool TraceFile::next(uint32_t pid, Entry &e) {
         return true;
     } 
 
-    // If we are waiting at a barrier, don't advance trace and return a NOP
-    if (m_waiting[pid]) {
-        e.addr = 0;
-        e.type = ENTRY_TYPE_NOP;
+    // If we are waiting at a barrier, don't advance trace and read the
+    // barrier word instead
+    SyncState &sync = m_sync[pid];
+    if (sync.barrier != BARRIER_NONE) {
+        e.addr = sync.barrier_addr;
+        e.type = ENTRY_TYPE_BARRIER;
+        e.waiting = true;
+        if (sync.barrier == BARRIER_OPEN) {
+            sync.barrier = BARRIER_NONE;
+        }
         return true;
     }
     
     // Read current trace event into data.
-    m_input.seekg(m_positions[pid]);
-    m_input.read((char *)&data, sizeof(data));
-
-    // Transform data into host byte order.
-    data = ntohll(data);
-
-    // Seek to the next value.
-    m_positions[pid] += cpucount * sizeof(data);
+    data = read_entry(pid);
 
     // Decode event: separate Address and Type-Tag information
     // Three most significant bits are used for the entry type
@@ -278,23 +488,33 @@ bool TraceFile::next(uint32_t pid, Entry &e) {
     e.addr = data & ~(0b111LL << 61);
     e.type = (EntryType)(data >> 61);
 
+    // A lock held by another processor: spin on it without advancing.
+    if (e.type == ENTRY_TYPE_LOCK) {
+        auto lock = m_locks.find(e.addr);
+        if (lock != m_locks.end() && lock->second != pid) {
+            e.waiting = true;
+            return true;
+        }
+        m_locks[e.addr] = pid;
+    }
+
+    // Seek to the next value.
+    m_positions[pid] += cpucount * sizeof(data);
+
+    if (e.type == ENTRY_TYPE_UNLOCK) {
+        sync.releasing = true;
+        sync.lock_addr = e.addr;
+    }
+
     // Handle the barrier event.
     if (e.type == ENTRY_TYPE_BARRIER) {
-        m_waiting[pid] = true; // We are now waiting on the barrrier.
-
-        // If all threads are waiting, reset m_waiting so all can continue.
-        bool all_threads_waiting = std::all_of(m_waiting.begin(),
-                m_waiting.end(), [](bool element) { return element; });
-        if (all_threads_waiting) {
-            std::fill(m_waiting.begin(), m_waiting.end(), false);
-        }
-        // A barrier is treated as a NOP event.
-        e.addr = 0;
-        e.type = ENTRY_TYPE_NOP;
+        // We are now waiting on the barrier; the last one to arrive opens it.
+        sync.barrier_addr = e.addr;
+        sync.barrier = ++m_arrived == cpucount ? BARRIER_OPENING : BARRIER_WAITING;
         return true;
     }
 
-    // Now handle: NOP, READ and WRITE
+    // Now handle: NOP, READ, WRITE, ATOMIC, LOCK and UNLOCK
 
     // Check if we encountered an end tag
     if (e.type == ENTRY_TYPE_END) {
@@ -15,8 +15,10 @@
 #define PSA_H
 
 #include <fstream>
+#include <unordered_map>
 #include <vector>
 
+#include "checkpoint.h"
 #include "helpers.h"
 
 // Define fixed-size types
@@ -56,12 +58,42 @@ void stats_cleanup();
 // Pretty-prints the contents of the statistic counters
 void stats_print();
 
+/*
+ * Enables or disables updates of the statistic counters. Used to keep
+ * warm-up accesses out of the reported numbers.
+ */
+void stats_set_enabled(bool enabled);
+bool stats_get_enabled();
+
+// Returns the number of hits and accesses counted so far for given CPU
+uint64_t stats_hits(uint32_t cpuid);
+uint64_t stats_accesses(uint32_t cpuid);
+
 // Updates the internal statistic counters for given CPU
 void stats_writehit(uint32_t cpuid);
 void stats_writemiss(uint32_t cpuid);
 void stats_readhit(uint32_t cpuid);
 void stats_readmiss(uint32_t cpuid);
 
+/*
+ * Writes a checkpoint with the tracefile positions, barrier state, statistic
+ * counters and current simulated time, followed by the state of each of the
+ * given components. Should only be called while all components are idle.
+ */
+void checkpoint_save(const char *filename,
+                     const std::vector<Checkpointable *> &components);
+
+/*
+ * Restores a checkpoint written by checkpoint_save(). Needs to be run after
+ * init_tracefile() and stats_init(), and before the simulation is started.
+ * The components must be given in the same order as when saving.
+ */
+void checkpoint_restore(const char *filename,
+                        const std::vector<Checkpointable *> &components);
+
+// Returns the simulated time including the time restored from a checkpoint
+sc_time simulation_time();
+
 // Declaration of a constant to put a 64 bit wire in high impedance mode.
 extern const char *float_64_bit_wire;
 
@@ -73,13 +105,19 @@ class TraceFile {
         ENTRY_TYPE_READ = 0x1,
         ENTRY_TYPE_WRITE = 0x2,
         ENTRY_TYPE_END = 0x3, // End is only used internally
-        ENTRY_TYPE_BARRIER = 0x4
+        ENTRY_TYPE_BARRIER = 0x4,
+        ENTRY_TYPE_ATOMIC = 0x5, // Atomic read-modify-write
+        ENTRY_TYPE_LOCK = 0x6,   // Lock acquire
+        ENTRY_TYPE_UNLOCK = 0x7  // Lock release
     };
 
     // Data type of a memory request entry for a processor
     struct Entry {
         EntryType type;
         uint64_t addr;
+        // Set by next() while the processor waits at a lock or barrier: the
+        // entry is then a read of the lock or barrier word at addr.
+        bool waiting = false;
     };
 
     // Constructor / Destructor
@@ -93,25 +131,75 @@ class TraceFile {
      * Reads the next entry from the file for the processor specified in pid.
      * Parameter e is a reference to the Entry structure which will receive
      * the data.
+     *
+     * Locks and barriers are resolved here. A lock entry acquires the lock
+     * at its address; while another processor holds it, the trace does not
+     * advance and the same entry is returned with waiting set. A barrier
+     * entry is the arrival at the barrier, after which barrier entries with
+     * waiting set are returned until every processor arrived; the address of
+     * the barrier entry is that of its counter. The release of a lock and
+     * the opening of a barrier by the last processor to arrive take effect
+     * at the next call for that processor, once its read-modify-write of
+     * the word is done. A waiting processor gets one more waiting entry
+     * after the barrier opened, the read that sees it open.
      */
     bool next(uint32_t pid, Entry &e);
 
+    /*
+     * Reads the next entry for processor pid as it is stored in the file,
+     * without barrier synchronization: barrier entries are returned as such
+     * and the trace of pid keeps advancing. Returns false once the trace of
+     * pid has ended. Meant for analysis tools that read the traces of the
+     * processors independently, it should not be mixed with next().
+     */
+    bool next_raw(uint32_t pid, Entry &e);
+
     // Determines if the end-of-file has been reached
     bool eof() const;
 
     // Returns the number of processors this file contains traces for
     uint32_t get_proc_count() const;
 
+    // Saves and restores the per processor positions, lock and barrier state
+    void save(CheckpointWriter &out) const;
+    void restore(CheckpointReader &in);
+
     private:
     const uint32_t entry_size = 8; // Trace element is 8 bytes.
     struct EntryInfo;
 
+    // Read-ahead buffer of a processor, holds the file contents starting at
+    // position start.
+    struct ReadBuffer {
+        std::vector<char> data;
+        std::streampos start = 0;
+        size_t size = 0;
+    };
+    static const size_t buffer_size = 32768;
+
     std::ifstream m_input;
     std::vector<std::streampos> m_positions;
-    std::vector<bool> m_waiting;
+    std::vector<ReadBuffer> m_buffers;
     uint32_t m_num_finished;
+
+    // Synchronization state of a processor
+    enum BarrierState { BARRIER_NONE, BARRIER_WAITING, BARRIER_OPENING, BARRIER_OPEN };
+    struct SyncState {
+        uint8_t barrier = BARRIER_NONE;
+        uint64_t barrier_addr = 0;
+        bool releasing = false;   // frees the lock at lock_addr on the next call
+        uint64_t lock_addr = 0;
+    };
+    std::vector<SyncState> m_sync;
+    std::unordered_map<uint64_t, uint32_t> m_locks; // held locks and their owner
+    uint32_t m_arrived; // processors at the current barrier
+
+    // Applies the deferred lock release or barrier opening of pid
+    void sync_done(uint32_t pid);
     std::streampos m_endstream;
 
+    uint64_t read_entry(uint32_t pid);
+
     // Private copy constructor because no copies are allowed.
     TraceFile(const TraceFile &trf);
 };
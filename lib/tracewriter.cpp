@@ -0,0 +1,72 @@
+/*
+// Source file for the Parallel System Architectures Lab Session helper
+// functions.
+// Contains the TraceWriter class, the counterpart of TraceFile that creates
+// tracefiles.
+*/
+
+#include "tracewriter.h"
+#include <arpa/inet.h>
+#include <iostream>
+#include <stdexcept>
+
+#if defined(__APPLE__)
+#include <libkern/OSByteOrder.h>
+#define htobe64(x) OSSwapHostToBigInt64(x)
+#else
+#include <endian.h>
+#endif
+
+using namespace std;
+
+TraceWriter::TraceWriter(const char *filename, uint32_t num_procs)
+: m_output(filename, ios::out | ios::binary | ios::trunc),
+  m_buffer(buffer_entries), m_fill(0), m_num_procs(num_procs), m_count(0) {
+    if (!m_output.is_open()) {
+        throw runtime_error(string("Unable to create file: ") + filename);
+    }
+    if (num_procs == 0) {
+        throw runtime_error("A tracefile needs at least one processor");
+    }
+
+    // File signature followed by the number of processors in network order
+    uint32_t procs_count = htonl(num_procs);
+    m_output.write("5TRF", 4);
+    m_output.write((const char *)&procs_count, sizeof(procs_count));
+}
+
+TraceWriter::~TraceWriter() {
+    if (m_output.is_open()) {
+        try {
+            close_without_end();
+        } catch (exception &e) {
+            cerr << e.what() << endl;
+        }
+    }
+}
+
+uint64_t TraceWriter::encode(TraceFile::EntryType type, uint64_t addr) {
+    // Three most significant bits hold the entry type
+    uint64_t data = ((uint64_t)type << 61) | (addr & ~(0b111ULL << 61));
+    return htobe64(data);
+}
+
+void TraceWriter::flush() {
+    m_output.write((const char *)m_buffer.data(), m_fill * sizeof(uint64_t));
+    if (m_output.fail()) {
+        throw runtime_error("Unable to write tracefile");
+    }
+    m_fill = 0;
+}
+
+void TraceWriter::close() {
+    for (uint32_t i = 0; i < m_num_procs; i++) {
+        write(TraceFile::ENTRY_TYPE_END, 0);
+    }
+    close_without_end();
+}
+
+void TraceWriter::close_without_end() {
+    flush();
+    m_output.close();
+}
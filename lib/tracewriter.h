@@ -0,0 +1,66 @@
+/*
+// Header file for the Parallel System Architectures Lab Session.
+// Contains the TraceWriter class, which creates tracefiles in the format
+// read by TraceFile. Entries are buffered and converted to big-endian in
+// blocks, so large traces can be written quickly.
+*/
+
+#ifndef TRACEWRITER_H
+#define TRACEWRITER_H
+
+#include <fstream>
+#include <vector>
+
+#include "psa.h"
+
+class TraceWriter {
+    public:
+    // Creates the file and writes the header for num_procs processors
+    TraceWriter(const char *filename, uint32_t num_procs);
+
+    // Flushes and closes the file if close() was not called yet
+    ~TraceWriter();
+
+    /*
+     * Appends one raw entry. Entries belong to processors in round-robin
+     * order, so the caller is responsible for interleaving the traces of the
+     * different processors.
+     */
+    void write(TraceFile::EntryType type, uint64_t addr) {
+        m_buffer[m_fill++] = encode(type, addr);
+        if (m_fill == m_buffer.size()) {
+            flush();
+        }
+        m_count++;
+    }
+
+    // Appends an END entry for every processor, then closes the file
+    void close();
+
+    // Closes the file without END entries
+    void close_without_end();
+
+    // Number of entries written so far
+    uint64_t count() const { return m_count; }
+
+    uint32_t get_proc_count() const { return m_num_procs; }
+
+    // Packs type and address into the big-endian on-disk representation
+    static uint64_t encode(TraceFile::EntryType type, uint64_t addr);
+
+    private:
+    static const size_t buffer_entries = 1 << 16;
+
+    std::ofstream m_output;
+    std::vector<uint64_t> m_buffer;
+    size_t m_fill;
+    uint32_t m_num_procs;
+    uint64_t m_count;
+
+    void flush();
+
+    // Private copy constructor because no copies are allowed.
+    TraceWriter(const TraceWriter &trw);
+};
+
+#endif
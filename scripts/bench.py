@@ -0,0 +1,201 @@
+#!/usr/bin/env python3
+
+# Benchmarks the speed of the simulator itself. Runs the microbenchmarks of
+# bench.bin and end-to-end simulations of the tracefiles, writes the results
+# as JSON and compares them with a stored baseline. Exits with status 1 when
+# a result is slower than the baseline by more than the threshold.
+#
+# The results are host timings, so a baseline only holds for the machine
+# that recorded it: every machine needs its own, made with --save-baseline
+# ("make bench-baseline") from a known good build.
+#
+# Usage: bench.py [--quick] [--save-baseline] [--threshold 0.1]
+
+import argparse
+import json
+import os
+import platform
+import re
+import struct
+import subprocess
+import sys
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+TRACE_DIR = os.path.join(ROOT, 'tracefiles')
+
+# Trace used for the microbenchmarks
+MICRO_TRACE = 'fft_1024_p1-O2.trf'
+
+# Mesh sizes for the multi-CPU traces, which run in the mesh network mode
+MESH = {2: '2x1', 4: '2x2', 8: '4x2'}
+
+# Simulated time is printed in ns, one cycle takes CLOCK_PERIOD_NS
+CLOCK_PERIOD_NS = 1.0
+
+# For every metric whether higher values are better
+HIGHER_IS_BETTER = {
+    'trace_next_ns': False,
+    'stats_update_ns': False,
+    'cache_access_ns': False,
+    'accesses_per_second': True,
+    'cycles_per_second': True,
+}
+
+
+def trace_cpus(path):
+    """Returns the number of CPUs of a trace, from its header."""
+    with open(path, 'rb') as f:
+        header = f.read(8)
+    return struct.unpack_from('>I', header, 4)[0]
+
+
+def timed_run(cmd, repeat):
+    """Runs cmd repeat times, returns the fastest wall time and its output."""
+    best = None
+    output = ''
+    for _ in range(repeat):
+        start = time.perf_counter()
+        result = subprocess.run(cmd, cwd=ROOT, stdout=subprocess.PIPE,
+                                stderr=subprocess.STDOUT, check=True)
+        elapsed = time.perf_counter() - start
+        if best is None or elapsed < best:
+            best = elapsed
+            output = result.stdout.decode('utf-8', errors='replace')
+    return best, output
+
+
+def run_micro(args):
+    trace = os.path.join(TRACE_DIR, MICRO_TRACE)
+    _, output = timed_run([args.bench, trace, '--repeat', str(args.repeat)], 1)
+    results = {}
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) == 3:
+            results[fields[0]] = float(fields[1])
+    return results
+
+
+def simulated_accesses(output):
+    """Sums the reads and writes of all CPUs in the statistics table."""
+    total = 0
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) == 10 and fields[0].isdigit():
+            total += int(fields[1]) + int(fields[4])
+    return total
+
+
+def run_trace(args, name):
+    path = os.path.join(TRACE_DIR, name)
+    num_procs = trace_cpus(path)
+    cmd = [args.simulator, path]
+    if num_procs > 1:
+        if num_procs not in MESH:
+            return None
+        cmd += ['--mesh', MESH[num_procs], '--llc-banks', str(min(num_procs, 4))]
+    seconds, output = timed_run(cmd, args.repeat)
+    match = re.search(r'Total simulation time: (\d+) ns', output)
+    if not match:
+        raise RuntimeError(f'no simulation time in the output of {name}')
+    cycles = int(match.group(1)) / CLOCK_PERIOD_NS
+    accesses = simulated_accesses(output)
+    return {
+        'cpus': num_procs,
+        'host_seconds': seconds,
+        'accesses': accesses,
+        'cycles': cycles,
+        'accesses_per_second': accesses / seconds,
+        'cycles_per_second': cycles / seconds,
+    }
+
+
+def compare(results, baseline, threshold):
+    """Prints the change against the baseline, returns the regressions."""
+    regressions = []
+    rows = [('micro/' + k, v, baseline.get('micro', {}).get(k))
+            for k, v in results['micro'].items()]
+    for name, run in results['traces'].items():
+        base = baseline.get('traces', {}).get(name, {})
+        for k in ('accesses_per_second', 'cycles_per_second'):
+            rows.append((name + '/' + k, run[k], base.get(k)))
+
+    print(f'{"Benchmark":<56} {"Result":>14} {"Baseline":>14} {"Change":>9}')
+    for name, value, base in rows:
+        metric = name.split('/')[-1]
+        if metric not in HIGHER_IS_BETTER:
+            continue
+        if not base:
+            print(f'{name:<56} {value:>14.4g} {"-":>14} {"":>9}')
+            continue
+        change = value / base - 1
+        slower = -change if HIGHER_IS_BETTER[metric] else change
+        flag = '  SLOWER' if slower > threshold else ''
+        print(f'{name:<56} {value:>14.4g} {base:>14.4g} {100 * change:>+8.1f}%{flag}')
+        if slower > threshold:
+            regressions.append(name)
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(
+            description='Benchmark the speed of the simulator')
+    parser.add_argument('--simulator', default=os.path.join(ROOT, 'assignment_1.bin'))
+    parser.add_argument('--bench', default=os.path.join(ROOT, 'bench.bin'))
+    parser.add_argument('-o', '--output', default=os.path.join(ROOT, 'bench_results.json'),
+            help='file to write the results to')
+    parser.add_argument('-b', '--baseline', default=os.path.join(ROOT, 'bench_baseline.json'),
+            help='results to compare with')
+    parser.add_argument('--save-baseline', action='store_true', default=False,
+            help='store the results as the new baseline')
+    parser.add_argument('-t', '--threshold', type=float, default=0.10,
+            help='relative slowdown reported as a regression (default 0.10)')
+    parser.add_argument('-r', '--repeat', type=int, default=3,
+            help='runs per benchmark, the fastest counts (default 3)')
+    parser.add_argument('-q', '--quick', action='store_true', default=False,
+            help='only the single CPU traces')
+    args = parser.parse_args()
+
+    results = {
+        'host': platform.node(),
+        'machine': platform.machine(),
+        'date': time.strftime('%Y-%m-%d %H:%M:%S'),
+        'micro': run_micro(args),
+        'traces': {},
+    }
+    for name in sorted(os.listdir(TRACE_DIR)):
+        if not name.endswith('.trf'):
+            continue
+        if args.quick and trace_cpus(os.path.join(TRACE_DIR, name)) > 1:
+            continue
+        print(f'Running {name}', file=sys.stderr)
+        run = run_trace(args, name)
+        if run:
+            results['traces'][name] = run
+
+    with open(args.output, 'w') as f:
+        json.dump(results, f, indent=2)
+    print(f'Results written to {args.output}')
+
+    if args.save_baseline:
+        with open(args.baseline, 'w') as f:
+            json.dump(results, f, indent=2)
+        print(f'Baseline written to {args.baseline}')
+        return 0
+
+    if not os.path.exists(args.baseline):
+        print(f'No baseline in {args.baseline}; baselines are per machine, '
+              f'run "make bench-baseline" on this one first')
+        return 0
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+    regressions = compare(results, baseline, args.threshold)
+    if regressions:
+        print(f'{len(regressions)} benchmarks slower than the baseline by more '
+              f'than {100 * args.threshold:.0f}%')
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -1,10 +1,11 @@
 import struct
 
 class Trace:
-    (TYPE_NOP, TYPE_READ, TYPE_WRITE, TYPE_END, TYPE_BARRIER) = range(5)
+    (TYPE_NOP, TYPE_READ, TYPE_WRITE, TYPE_END, TYPE_BARRIER,
+     TYPE_ATOMIC, TYPE_LOCK, TYPE_UNLOCK) = range(8)
 
     # use type_to_enum.index("R") to get the enum TYPE_READ value
-    type_to_enum = "NRWEB"
+    type_to_enum = "NRWEBALU"
 
     def __init__(self, filename, num_procs):
         self.num_procs = num_procs
@@ -31,8 +32,21 @@ class Trace:
     def write(self, addr):
         self.entry(Trace.TYPE_WRITE, addr)
 
-    def barrier(self):
-        self.entry(Trace.TYPE_BARRIER, 0x0)
+    # The address of a barrier is that of its counter, which the simulator
+    # updates on arrival and reads while waiting.
+    def barrier(self, addr=0x0):
+        self.entry(Trace.TYPE_BARRIER, addr)
+
+    # Atomic read-modify-write, e.g. a fetch-and-add.
+    def atomic(self, addr):
+        self.entry(Trace.TYPE_ATOMIC, addr)
+
+    # Acquires the lock at addr, waiting while another processor holds it.
+    def lock(self, addr):
+        self.entry(Trace.TYPE_LOCK, addr)
+
+    def unlock(self, addr):
+        self.entry(Trace.TYPE_UNLOCK, addr)
 
     def nop(self):
         self.entry(Trace.TYPE_NOP, 0x0)
@@ -48,8 +62,9 @@ class Trace:
 
 class Trace_reader:
     address_mask = ~(0b111 << 61)   # type stored in upper three bits.
-    map_type_to_char = "NRWEB"
-    map_type_to_string = ["NOP", "READ", "WRITE", "END", "BARRIER"]
+    map_type_to_char = "NRWEBALU"
+    map_type_to_string = ["NOP", "READ", "WRITE", "END", "BARRIER",
+                          "ATOMIC", "LOCK", "UNLOCK"]
 
     def __init__(self, filename):
         self.f = open(filename, "rb")
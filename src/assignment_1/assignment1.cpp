@@ -5,360 +5,296 @@
  * session. This uses the framework library to interface with tracefiles which
  * will drive the read/write requests
  *
+ * The components live in memory.h, cache.h, cpu.h and mmu.h; the multi-core,
+ * out-of-order and filter modes in network.cpp, ooo_cpu.cpp and filter.cpp.
+ * This file parses the options and runs the selected mode.
+ *
  * Author(s): Michiel W. van Tol, Mike Lankamp, Jony Zhang,
  *            Konstantinos Bousias, Simon Polstra
  *
  */
 
-#include <algorithm>
 #include <iostream>
-#include <optional>
+#include <memory>
+#include <sstream>
 #include <systemc>
-#include <cmath>
-#include <array>
-#include <list>
+#include <getopt.h>
 #include "psa.h"
+#include "cache.h"
+#include "config.h"
+#include "cpu.h"
+#include "mmu.h"
+#include "profile.h"
+
+// Parses a comma separated list of numbers.
+template <typename T>
+static vector<T> parse_list(const char *arg) {
+    vector<T> values;
+    stringstream s(arg);
+    string item;
+    while (getline(s, item, ','))
+        values.push_back((T)stod(item));
+    return values;
+}
 
-using namespace std;
-using namespace sc_core; // This pollutes namespace, better: only import what you need.
-using ADDRESS_UNIT = uint8_t;
-
-static constexpr size_t MEM_SIZE = 8912;
-static constexpr size_t CACHE_SETS = 128;
-static constexpr size_t CACHE_LINE_SIZE = 32;
-static constexpr size_t CACHE_WAYS = 8;
-
-static constexpr size_t CACHE_SIZE = CACHE_SETS * CACHE_WAYS * CACHE_LINE_SIZE;
-
-static constexpr size_t OFFSET_BITS = std::log2(CACHE_LINE_SIZE / sizeof(ADDRESS_UNIT)); // 5
-static constexpr size_t INDEX_BITS = std::log2(CACHE_SETS); // 7
-
-static_assert(CACHE_SIZE % (CACHE_LINE_SIZE * CACHE_WAYS) == 0,
-              "Cache size must be a multiple of cache line size * cache ways");
-
-
-SC_MODULE(Memory) {
-    public:
-    enum Function { FUNC_READ, FUNC_WRITE };
-
-    enum RetCode { RET_READ_DONE, RET_WRITE_DONE };
-
-    sc_in<bool> Port_CLK;
-    sc_in<Function> Port_Func;
-    sc_in<uint64_t> Port_Addr;
-    sc_out<RetCode> Port_Done;
-    sc_inout_rv<sizeof(ADDRESS_UNIT) * 32> Port_Data;
-
-    SC_CTOR(Memory) {
-        SC_THREAD(execute);
-        sensitive << Port_CLK.pos();
-        dont_initialize();
-
-        m_data = new ADDRESS_UNIT[MEM_SIZE];
+// Parses an "entries:ways" TLB geometry.
+static void parse_geometry(const char *arg, size_t &entries, size_t &ways) {
+    string s(arg);
+    size_t colon = s.find(':');
+    entries = stoull(s.substr(0, colon));
+    if (colon != string::npos) {
+        ways = stoull(s.substr(colon + 1));
     }
+}
 
-    ~Memory() {
-        delete[] m_data;
-    }
+static void usage(const char *prog) {
+    cerr << "Usage: " << prog << " <tracefile> [options]" << endl
+         << "  --sample-interval N  sample one window every N accesses" << endl
+         << "  --sample-size N      measured accesses per window (default 1000)" << endl
+         << "  --sample-warmup N    detailed accesses before each window (default 0)" << endl
+         << "  --fast-forward N     warm the caches functionally for N accesses" << endl
+         << "  --checkpoint-save F  write a checkpoint to F and stop" << endl
+         << "  --checkpoint-at N    access count at which to write the checkpoint" << endl
+         << "                       (default: the --fast-forward count)" << endl
+         << "  --checkpoint-restore F  start from the checkpoint in F, which needs the" << endl
+         << "                       cache, TLB and sampling options it was written with" << endl
+         << "  --tlb                translate addresses through TLBs and page tables" << endl
+         << "  --page-size N        page size in bytes, e.g. 2097152 (default 4096)" << endl
+         << "  --tlb-l1 E[:W]       L1 TLB entries and ways (default 64:4)" << endl
+         << "  --tlb-l2 E[:W]       L2 TLB entries and ways (default 1024:8)" << endl
+         << "  --tlb-l2-latency N   L2 TLB hit latency in cycles (default 7)" << endl
+         << "  --index F            set index function: modulo, xor, prime or skewed" << endl
+         << "  --victim-cache N     add a fully-associative victim cache of N lines" << endl
+         << "  --compress           store BDI compressed lines, with twice the tags" << endl
+         << "  --decompression-latency N  extra cycles on hits to compressed lines (default 1)" << endl
+         << "  --write-through      write stores to memory instead of marking lines dirty" << endl
+         << "  --no-write-allocate  send write misses to memory without fetching the line" << endl
+         << "  --write-combining N  combine stores to memory in an N entry buffer" << endl
+         << "  --sectors N          lines of N sectors of 32 bytes with one tag (default 1)" << endl
+         << "  --profile            print thread resumes, delta cycles, signal writes and" << endl
+         << "                       host time per module" << endl
+         << "  --filter F           write the misses and write-backs of a cache per CPU to" << endl
+         << "                       tracefile F instead of simulating. Write-backs become" << endl
+         << "                       plain writes, so filtering F again with a write-allocate" << endl
+         << "                       cache fetches a line for every write-back it misses on" << endl
+         << "  --mesh WxH           run every CPU of the trace with its own cache, connected" << endl
+         << "                       over a WxH mesh network to a banked LLC" << endl
+         << "  --vcs N              virtual channels per router port (default 2)" << endl
+         << "  --vc-buffer N        flits per virtual channel (default 4)" << endl
+         << "  --link-latency N     cycles per network link (default 1)" << endl
+         << "  --link-width N       bytes per flit (default 16)" << endl
+         << "  --router-latency N   cycles per router (default 1)" << endl
+         << "  --llc-banks N        LLC banks spread over the mesh (default 4)" << endl
+         << "  --llc-sets N         sets per LLC bank (default 256)" << endl
+         << "  --llc-ways N         LLC ways (default 8)" << endl
+         << "  --llc-latency N      LLC hit latency in cycles (default 10)" << endl
+         << "  --miss-sets N        sets listed in the miss classification, 0 for all" << endl
+         << "                       (default 8)" << endl
+         << "  --program F          run the single-CPU tracefile F as another program on its" << endl
+         << "                       own core, sharing the LLC; can be given several times" << endl
+         << "  --partition P        LLC way-partitioning: none, static or ucp (default none)" << endl
+         << "  --partition-ways L   ways per program for static partitioning, e.g. 6,2" << endl
+         << "  --ucp-interval N     LLC accesses between UCP repartitionings (default 1000)" << endl
+         << "  --alone-ipc L        IPC proxy of every program run alone, for the weighted" << endl
+         << "                       speedup and fairness" << endl
+         << "  --ooo                out-of-order core that overlaps misses, instead of the" << endl
+         << "                       blocking CPU" << endl
+         << "  --issue-width N      entries dispatched, issued and retired per cycle (default 4)" << endl
+         << "  --rob N              reorder window entries (default 64)" << endl
+         << "  --lsq N              load/store queue entries (default 16)" << endl
+         << "  --mshrs N            outstanding misses (default 8)" << endl
+         << "  --hit-latency N      cache hit latency of the out-of-order core (default 2)" << endl
+         << "  --miss-latency N     cache miss latency of the out-of-order core (default 102)" << endl;
+}
 
-    private:
-    ADDRESS_UNIT *m_data;
-
-    void execute() {
-        while (true) {
-            wait(Port_Func.value_changed_event());
-
-            Function f = Port_Func.read();
-            uint64_t addr = Port_Addr.read();
-            uint32_t data = 0;
-            if (f == FUNC_WRITE) {
-                data = Port_Data.read().to_uint();
-                log(name(), "received write on address", addr, "with data", data);
-            } else {
-                log(name(), "received read on address", addr);
-            }
-
-            // This simulates memory read/write delay
-            wait(100);
-
-            if (f == FUNC_READ) {
-                Port_Data.write((addr < MEM_SIZE) ? m_data[addr] : 0);
-                Port_Done.write(RET_READ_DONE);
-                wait();
-                Port_Data.write(float_64_bit_wire); // string with 64 "Z"'s
-            } else {
-                if (addr < MEM_SIZE) {
-                    m_data[addr] = data;
-                }
-                Port_Done.write(RET_WRITE_DONE);
-            }
-        }
-    }
-};
-
-struct Cacheline {
-    size_t _idx;
-    size_t tag = 0;
-    bool valid = false;
-    bool dirty = false;
-    array<uint32_t, CACHE_LINE_SIZE / sizeof(ADDRESS_UNIT)> data {};
-};
-
-struct Cacheset {
-    list<Cacheline> lines {};
-
-    Cacheset(){
-        for(size_t way =0; way<CACHE_WAYS; ++way){
-            Cacheline line{way};
-            lines.emplace_back(line);
+// Parses the options that remain after init_tracefile() took the tracefile.
+static Config parse_options(int argc, char *argv[]) {
+    enum {
+        OPT_SAMPLE_INTERVAL = 256, OPT_SAMPLE_SIZE, OPT_SAMPLE_WARMUP,
+        OPT_FAST_FORWARD, OPT_CHECKPOINT_SAVE, OPT_CHECKPOINT_AT,
+        OPT_CHECKPOINT_RESTORE, OPT_TLB, OPT_PAGE_SIZE, OPT_TLB_L1, OPT_TLB_L2,
+        OPT_TLB_L2_LATENCY, OPT_INDEX, OPT_VICTIM_CACHE, OPT_COMPRESS,
+        OPT_DECOMPRESSION_LATENCY, OPT_WRITE_THROUGH, OPT_NO_WRITE_ALLOCATE,
+        OPT_WRITE_COMBINING, OPT_MESH, OPT_VCS, OPT_VC_BUFFER, OPT_LINK_LATENCY,
+        OPT_LINK_WIDTH, OPT_ROUTER_LATENCY, OPT_LLC_BANKS, OPT_LLC_SETS,
+        OPT_LLC_WAYS, OPT_LLC_LATENCY, OPT_MISS_SETS, OPT_PROGRAM, OPT_PARTITION,
+        OPT_PARTITION_WAYS, OPT_UCP_INTERVAL, OPT_ALONE_IPC, OPT_OOO, OPT_ISSUE_WIDTH,
+        OPT_ROB, OPT_LSQ, OPT_MSHRS, OPT_HIT_LATENCY, OPT_MISS_LATENCY, OPT_SECTORS,
+        OPT_PROFILE, OPT_FILTER
+    };
+    static const option long_options[] = {
+        {"sample-interval", required_argument, nullptr, OPT_SAMPLE_INTERVAL},
+        {"sample-size", required_argument, nullptr, OPT_SAMPLE_SIZE},
+        {"sample-warmup", required_argument, nullptr, OPT_SAMPLE_WARMUP},
+        {"fast-forward", required_argument, nullptr, OPT_FAST_FORWARD},
+        {"checkpoint-save", required_argument, nullptr, OPT_CHECKPOINT_SAVE},
+        {"checkpoint-at", required_argument, nullptr, OPT_CHECKPOINT_AT},
+        {"checkpoint-restore", required_argument, nullptr, OPT_CHECKPOINT_RESTORE},
+        {"tlb", no_argument, nullptr, OPT_TLB},
+        {"page-size", required_argument, nullptr, OPT_PAGE_SIZE},
+        {"tlb-l1", required_argument, nullptr, OPT_TLB_L1},
+        {"tlb-l2", required_argument, nullptr, OPT_TLB_L2},
+        {"tlb-l2-latency", required_argument, nullptr, OPT_TLB_L2_LATENCY},
+        {"index", required_argument, nullptr, OPT_INDEX},
+        {"victim-cache", required_argument, nullptr, OPT_VICTIM_CACHE},
+        {"compress", no_argument, nullptr, OPT_COMPRESS},
+        {"decompression-latency", required_argument, nullptr, OPT_DECOMPRESSION_LATENCY},
+        {"write-through", no_argument, nullptr, OPT_WRITE_THROUGH},
+        {"no-write-allocate", no_argument, nullptr, OPT_NO_WRITE_ALLOCATE},
+        {"write-combining", required_argument, nullptr, OPT_WRITE_COMBINING},
+        {"mesh", required_argument, nullptr, OPT_MESH},
+        {"vcs", required_argument, nullptr, OPT_VCS},
+        {"vc-buffer", required_argument, nullptr, OPT_VC_BUFFER},
+        {"link-latency", required_argument, nullptr, OPT_LINK_LATENCY},
+        {"link-width", required_argument, nullptr, OPT_LINK_WIDTH},
+        {"router-latency", required_argument, nullptr, OPT_ROUTER_LATENCY},
+        {"llc-banks", required_argument, nullptr, OPT_LLC_BANKS},
+        {"llc-sets", required_argument, nullptr, OPT_LLC_SETS},
+        {"llc-ways", required_argument, nullptr, OPT_LLC_WAYS},
+        {"llc-latency", required_argument, nullptr, OPT_LLC_LATENCY},
+        {"miss-sets", required_argument, nullptr, OPT_MISS_SETS},
+        {"sectors", required_argument, nullptr, OPT_SECTORS},
+        {"profile", no_argument, nullptr, OPT_PROFILE},
+        {"filter", required_argument, nullptr, OPT_FILTER},
+        {"program", required_argument, nullptr, OPT_PROGRAM},
+        {"partition", required_argument, nullptr, OPT_PARTITION},
+        {"partition-ways", required_argument, nullptr, OPT_PARTITION_WAYS},
+        {"ucp-interval", required_argument, nullptr, OPT_UCP_INTERVAL},
+        {"alone-ipc", required_argument, nullptr, OPT_ALONE_IPC},
+        {"ooo", no_argument, nullptr, OPT_OOO},
+        {"issue-width", required_argument, nullptr, OPT_ISSUE_WIDTH},
+        {"rob", required_argument, nullptr, OPT_ROB},
+        {"lsq", required_argument, nullptr, OPT_LSQ},
+        {"mshrs", required_argument, nullptr, OPT_MSHRS},
+        {"hit-latency", required_argument, nullptr, OPT_HIT_LATENCY},
+        {"miss-latency", required_argument, nullptr, OPT_MISS_LATENCY},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}};
+
+    Config config;
+    bool checkpoint_at_set = false;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, nullptr)) != -1) {
+        switch (opt) {
+        case OPT_SAMPLE_INTERVAL: config.sample_interval = stoull(optarg); break;
+        case OPT_SAMPLE_SIZE: config.sample_size = stoull(optarg); break;
+        case OPT_SAMPLE_WARMUP: config.sample_warmup = stoull(optarg); break;
+        case OPT_FAST_FORWARD: config.fast_forward = stoull(optarg); break;
+        case OPT_CHECKPOINT_SAVE: config.checkpoint_save = optarg; break;
+        case OPT_CHECKPOINT_AT:
+            config.checkpoint_at = stoull(optarg);
+            checkpoint_at_set = true;
+            break;
+        case OPT_CHECKPOINT_RESTORE: config.checkpoint_restore = optarg; break;
+        case OPT_TLB: config.tlb.enabled = true; break;
+        case OPT_PAGE_SIZE: config.tlb.page_size = stoull(optarg); break;
+        case OPT_TLB_L1:
+            parse_geometry(optarg, config.tlb.l1_entries, config.tlb.l1_ways);
+            break;
+        case OPT_TLB_L2:
+            parse_geometry(optarg, config.tlb.l2_entries, config.tlb.l2_ways);
+            break;
+        case OPT_TLB_L2_LATENCY: config.tlb.l2_latency = stoul(optarg); break;
+        case OPT_INDEX: config.cache.index = parse_index_function(optarg); break;
+        case OPT_VICTIM_CACHE: config.cache.victim_entries = stoull(optarg); break;
+        case OPT_COMPRESS: config.cache.compression = true; break;
+        case OPT_DECOMPRESSION_LATENCY:
+            config.cache.decompression_latency = stoul(optarg);
+            break;
+        case OPT_WRITE_THROUGH: config.cache.write_through = true; break;
+        case OPT_NO_WRITE_ALLOCATE: config.cache.write_allocate = false; break;
+        case OPT_WRITE_COMBINING:
+            config.cache.write_combining = stoull(optarg);
+            break;
+        case OPT_MESH:
+            noc_parse_mesh(optarg, config.mesh);
+            config.noc = true;
+            break;
+        case OPT_VCS: config.mesh.vcs = stoul(optarg); break;
+        case OPT_VC_BUFFER: config.mesh.buffer_depth = stoul(optarg); break;
+        case OPT_LINK_LATENCY: config.mesh.link_latency = stoul(optarg); break;
+        case OPT_LINK_WIDTH: config.mesh.link_width = stoul(optarg); break;
+        case OPT_ROUTER_LATENCY: config.mesh.router_latency = stoul(optarg); break;
+        case OPT_LLC_BANKS: config.llc.banks = stoull(optarg); break;
+        case OPT_LLC_SETS: config.llc.sets = stoull(optarg); break;
+        case OPT_LLC_WAYS: config.llc.ways = stoull(optarg); break;
+        case OPT_LLC_LATENCY: config.llc.latency = stoul(optarg); break;
+        case OPT_MISS_SETS: config.cache.miss_sets = stoull(optarg); break;
+        case OPT_SECTORS: config.cache.sectors = stoull(optarg); break;
+        case OPT_PROFILE: config.profile = true; break;
+        case OPT_FILTER: config.filter = optarg; break;
+        case OPT_PROGRAM: config.programs.push_back(optarg); break;
+        case OPT_PARTITION: config.llc.partition = parse_partition_policy(optarg); break;
+        case OPT_PARTITION_WAYS:
+            config.llc.partition_ways = parse_list<size_t>(optarg);
+            break;
+        case OPT_UCP_INTERVAL: config.llc.ucp_interval = stoull(optarg); break;
+        case OPT_ALONE_IPC: config.alone_ipc = parse_list<double>(optarg); break;
+        case OPT_OOO: config.ooo.enabled = true; break;
+        case OPT_ISSUE_WIDTH: config.ooo.width = stoul(optarg); break;
+        case OPT_ROB: config.ooo.rob = stoull(optarg); break;
+        case OPT_LSQ: config.ooo.lsq = stoull(optarg); break;
+        case OPT_MSHRS: config.ooo.mshrs = stoull(optarg); break;
+        case OPT_HIT_LATENCY: config.ooo.hit_latency = stoul(optarg); break;
+        case OPT_MISS_LATENCY: config.ooo.miss_latency = stoul(optarg); break;
+        case 'h':
+            usage(argv[0]);
+            exit(0);
+        default:
+            usage(argv[0]);
+            throw runtime_error("Error, invalid arguments");
         }
     }
 
-    void touch(Cacheline& way)
-    {
-        auto iter = find_if(lines.begin(), lines.end(), [&](Cacheline& e){return &e == &way;});
-        if(iter == lines.end())
-            return;
-        lines.splice(lines.begin(), lines, iter);
-    }
-    Cacheline& evict()
-    {
-        return lines.back();
+    if (config.sample_interval > 0 &&
+        (config.sample_size == 0 ||
+         config.sample_size + config.sample_warmup > config.sample_interval)) {
+        throw runtime_error("Error, sample size plus warm-up must be between 1 "
+                            "and the sample interval");
     }
-
-};
-
-SC_MODULE(Cache) {
-    public:
-    sc_in<bool> Port_CLK;
-
-    sc_in<Memory::Function> Port_Func;
-    sc_out<Memory::RetCode> Port_Done;
-
-    sc_in<uint64_t> Port_Addr;
-    sc_inout_rv<sizeof(ADDRESS_UNIT) * 32> Port_Data;
-
-    sc_out<Memory::Function> Port_MemFunc;
-    sc_in<Memory::RetCode> Port_MemDone;
-
-    sc_out<uint64_t> Port_MemAddr;
-    sc_inout_rv<sizeof(ADDRESS_UNIT) * 32> Port_MemData;
-
-    SC_CTOR(Cache) {
-        SC_THREAD(execute);
-        sensitive << Port_CLK.pos();
-        dont_initialize();
-
+    if (!checkpoint_at_set) {
+        config.checkpoint_at = config.fast_forward;
     }
-
-private:
-    array<Cacheset, CACHE_SETS> m_cache;
-
-    void write_out_read(ADDRESS_UNIT data)
-    {
-        Port_Data.write(data);
-        Port_Done.write(Memory::RET_READ_DONE);
-        wait();
-        Port_Data.write(float_64_bit_wire); // string with 64 "Z"'s
+    size_t sectors = config.cache.sectors;
+    if (sectors == 0 || sectors > 32 || (sectors & (sectors - 1)) || sectors > CACHE_SETS) {
+        throw runtime_error("Error, the sectors per line must be a power of two up to 32");
     }
-
-    void execute()
-    {
-        while (true) {
-            wait(Port_Func.value_changed_event());
-
-            Memory::Function f = Port_Func.read();
-            uint64_t addr = Port_Addr.read();
-            std::optional<uint32_t> result; // result will be gone if we not gonna take it instantly.
-
-            if (f == Memory::FUNC_WRITE)
-                result = Port_Data.read().to_uint();
-
-            size_t offset = addr & ((1 << OFFSET_BITS) - 1); // offset bitmask -> indicates which offset in cacheline we select.
-            size_t index  = (addr >> OFFSET_BITS) & ((1 << INDEX_BITS) - 1); // index bitmask -> indicates which cache set we select.
-            size_t tag    = addr >> (OFFSET_BITS + INDEX_BITS); // leftovers for tag -> matching the cacheline itself!
-
-            auto& current_set = m_cache[index];
-
-            if (f == Memory::FUNC_READ)
-                log(name(), "read address =", addr);
-            if (f == Memory::FUNC_WRITE)
-                log(name(), "write address =", addr);
-
-            wait(1);
-
-            bool found = false;
-            for (Cacheline& way : current_set.lines) {
-                if (way.valid && way.tag == tag) {
-                    // fast path
-                    current_set.touch(way);
-                    if (f == Memory::FUNC_READ) {
-                        log(name(), "read hit address =", addr, "set =", index, "line =", way._idx);
-                        // touch line to make sure it's recently used.
-                        write_out_read(way.data[offset]);
-                        stats_readhit(0);
-                    }
-                    if (f == Memory::FUNC_WRITE) {
-                        log(name(), "write hit address =", addr, "set =", index, "line =", way._idx);
-                        way.data[offset] = result.value();
-                        way.dirty = true;
-                        Port_Done.write(Memory::RET_WRITE_DONE);
-                        stats_writehit(0);
-                    }
-                    found = true;
-                    break;
-                }
-            }
-
-            if (found)
-                continue;
-
-            if (f == Memory::FUNC_READ) {
-                stats_readmiss(0);
-                log(name(), "read miss address =", addr);
-            } else {
-                stats_writemiss(0);
-                log(name(), "write miss address =", addr);
-            }
-
-            // Taking a slow path. Accessing memory
-
-            Port_MemAddr.write(addr);
-            Port_MemFunc.write(Memory::FUNC_READ);
-            wait(Port_MemDone.value_changed_event());
-
-            if (f == Memory::FUNC_READ) 
-                result = Port_MemData.read().to_uint();
-
-            Cacheline* assign_way = nullptr;
-
-            for (Cacheline& way : current_set.lines) {
-                if (!way.valid) {
-                    assign_way = &way;
-                    break;
-                }
-            }
-
-            if (assign_way == nullptr) {
-                // Lack of space in the cacheset.
-                // Evict the last one.
-                assign_way = &current_set.evict();
-
-                uint64_t victim_line_addr = assign_way->tag << (INDEX_BITS + OFFSET_BITS) | (index << OFFSET_BITS);
-                if (assign_way->dirty) {
-                    log(name(), "evict dirty line address =", victim_line_addr, "set =", index, "line =", assign_way->_idx);
-                    Port_MemAddr.write(victim_line_addr);
-                    Port_MemData.write(assign_way->data[offset]);
-                    wait(); // HACK: Find out the reason why this happens.
-                            // Some sort of race condition, just the question is why.
-                    Port_MemFunc.write(Memory::FUNC_WRITE);
-                    wait(Port_MemDone.value_changed_event());
-                    Port_MemData.write(float_64_bit_wire);
-                } else {
-                    log(name(), "evict clean line address =", victim_line_addr, "set =", index, "line =", assign_way->_idx);
-                }
-
-            }
-
-            // Overwrite and put it to the front
-            assign_way->tag = tag;
-            assign_way->data[offset] = result.value();
-            assign_way->valid = true;
-            assign_way->dirty = (f == Memory::FUNC_WRITE);
-            current_set.touch(*assign_way);
-
-            log(name(), "write completed address =", addr, "set =", index, "line =", assign_way->_idx);
-
-            if (f == Memory::FUNC_READ) {
-                write_out_read(result.value());
-                log(name(), "read done address =", addr);
-            } else {
-                Port_Done.write(Memory::RET_WRITE_DONE);
-                log(name(), "write done address =", addr);
-            }
+    if (!config.programs.empty()) {
+        config.llc.separate_address_spaces = true;
+        if (!config.noc) {
+            // The smallest mesh of at least 2x2 with a node per program
+            size_t n = config.programs.size() + 1;
+            config.mesh.width = max<size_t>(2, ceil(sqrt((double)n)));
+            config.mesh.height = max<size_t>(2, (n + config.mesh.width - 1) / config.mesh.width);
+            config.noc = true;
         }
     }
-};
-
-SC_MODULE(CPU) {
-    public:
-    sc_in<bool> Port_CLK;
-    sc_in<Memory::RetCode> Port_MemDone;
-    sc_out<Memory::Function> Port_MemFunc;
-    sc_out<uint64_t> Port_MemAddr;
-    sc_inout_rv<sizeof(ADDRESS_UNIT) * 32> Port_MemData;
-
-    SC_CTOR(CPU) {
-        SC_THREAD(execute);
-        sensitive << Port_CLK.pos();
-        dont_initialize();
+    if (config.ooo.enabled && (config.noc || config.tlb.enabled || config.sample_interval ||
+                               config.checkpoint_save || config.checkpoint_restore)) {
+        throw runtime_error("Error, the out-of-order core does not support the mesh network, "
+                            "the TLB, sampling or checkpoints");
     }
-
-    private:
-    void execute() {
-        TraceFile::Entry tr_data;
-        Memory::Function f;
-
-        // Loop until end of tracefile
-        while (!tracefile_ptr->eof()) {
-            // Get the next action for the processor in the trace
-            if (!tracefile_ptr->next(0, tr_data)) {
-                cerr << "Error reading trace for CPU" << endl;
-                break;
-            }
-
-            switch (tr_data.type) {
-            case TraceFile::ENTRY_TYPE_READ:
-                f = Memory::FUNC_READ;
-                break;
-
-            case TraceFile::ENTRY_TYPE_WRITE:
-                f = Memory::FUNC_WRITE;
-                break;
-
-            case TraceFile::ENTRY_TYPE_NOP: break;
-
-            default:
-                cerr << "Error, got invalid data from Trace" << endl;
-                exit(0);
-            }
-
-            if (tr_data.type != TraceFile::ENTRY_TYPE_NOP) {
-                Port_MemAddr.write(tr_data.addr);
-                Port_MemFunc.write(f);
-
-                if (f == Memory::FUNC_WRITE) {
-                    // No data in trace, use address * 10 as data value.
-                    ADDRESS_UNIT data = tr_data.addr * 10;
-                    log(name(), "write value", data,
-                            "to address", tr_data.addr);
-                    Port_MemData.write(data);
-                    wait();
-                    // Now float the data wires with 64 "Z"'s
-                    Port_MemData.write(float_64_bit_wire);
-
-                } else {
-                    log(name(), "read on address", tr_data.addr);
-                }
-
-                wait(Port_MemDone.value_changed_event());
-
-                if (f == Memory::FUNC_READ) {
-                    log(name(), "read data", Port_MemData.read().to_uint(),
-                            "from address", tr_data.addr);
-                }
-            } else {
-                log(name(), "executing NOP");
-            }
-            // Advance one cycle in simulated time
-            wait();
-        }
-
-        // Finished the Tracefile, now stop the simulation
-        sc_stop();
+    if (config.ooo.enabled && (config.ooo.width == 0 || config.ooo.rob == 0 ||
+                               config.ooo.lsq == 0 || config.ooo.mshrs == 0)) {
+        throw runtime_error("Error, the out-of-order core needs a width, ROB, LSQ and MSHRs");
     }
-};
-
+    if (!config.filter.empty() && (config.noc || config.ooo.enabled || config.tlb.enabled ||
+                                   config.sample_interval || config.checkpoint_save ||
+                                   config.checkpoint_restore)) {
+        throw runtime_error("Error, filtering runs the caches only, without the mesh network, "
+                            "the out-of-order core, the TLB, sampling or checkpoints");
+    }
+    if (config.llc.partition != PARTITION_NONE && !config.noc) {
+        throw runtime_error("Error, LLC partitioning needs the mesh network or --program");
+    }
+    if (config.noc && (config.tlb.enabled || config.sample_interval ||
+                       config.fast_forward || config.checkpoint_save ||
+                       config.checkpoint_restore)) {
+        throw runtime_error("Error, the mesh network does not support the TLB, "
+                            "sampling, fast-forwarding or checkpoints");
+    }
+    return config;
+}
 
 int sc_main(int argc, char *argv[]) {
     sc_report_handler::set_verbosity_level(SC_MEDIUM);
@@ -370,28 +306,86 @@ int sc_main(int argc, char *argv[]) {
         // Get the tracefile argument and create Tracefile object
         // This function sets tracefile_ptr and num_cpus
         init_tracefile(&argc, &argv);
+        Config config = parse_options(argc, argv);
+
+        // Every extra program gets a core and statistics of its own
+        vector<unique_ptr<TraceFile>> programs = open_programs(config);
 
         // Initialize statistics counters
         stats_init();
 
+        if (!config.filter.empty()) {
+            run_filter(config);
+            return 0;
+        }
+        if (config.ooo.enabled) {
+            run_ooo(config);
+            return 0;
+        }
+        if (config.noc) {
+            run_noc(config, programs);
+            return 0;
+        }
+
+        Sampler sampler(config.sample_interval, config.sample_size,
+                        config.sample_warmup);
+
         // Instantiate Modules
         Memory mem("memory");
         CPU cpu("cpu");
-        Cache cache("cache");
+        Cache cache("cache", config.cache);
+        unique_ptr<Mmu> mmu;
+        if (config.tlb.enabled) {
+            mmu = make_unique<Mmu>("mmu", config.tlb);
+        }
 
         // Signals
-        sc_buffer<Memory::Function> sigMemFunc;
-        sc_buffer<Memory::RetCode> sigMemDone;
-        sc_signal<uint64_t> sigMemAddr;
-        sc_signal_rv<sizeof(ADDRESS_UNIT) * 32> sigMemData;
-
-        sc_buffer<Memory::Function> sigCacheFunc;
-        sc_buffer<Memory::RetCode> sigCacheDone;
-        sc_signal<uint64_t> sigCacheAddr;
-        sc_signal_rv<sizeof(ADDRESS_UNIT) * 32> sigCacheData;
+        ProfiledBuffer<Memory::Function> sigMemFunc;
+        ProfiledBuffer<Memory::RetCode> sigMemDone;
+        ProfiledSignal<uint64_t> sigMemAddr;
+        ProfiledSignalRv<sizeof(ADDRESS_UNIT) * 32> sigMemData;
+
+        ProfiledBuffer<Memory::Function> sigCacheFunc;
+        ProfiledBuffer<Memory::RetCode> sigCacheDone;
+        ProfiledSignal<uint64_t> sigCacheAddr;
+        ProfiledSignalRv<sizeof(ADDRESS_UNIT) * 32> sigCacheData;
+
+        // Between the MMU and the cache, when translation is enabled
+        ProfiledBuffer<Memory::Function> sigPhysFunc;
+        ProfiledBuffer<Memory::RetCode> sigPhysDone;
+        ProfiledSignal<uint64_t> sigPhysAddr;
+        ProfiledSignalRv<sizeof(ADDRESS_UNIT) * 32> sigPhysData;
 
         // The clock that will drive the CPU and Memory
-        sc_clock clk;
+        sc_clock clk("clk", sc_time(CLOCK_PERIOD_NS, SC_NS));
+
+        cpu.functional = &cache;
+        if (mmu) {
+            mmu->lower = &cache;
+            cpu.functional = mmu.get();
+        }
+        cpu.fast_forward = config.fast_forward;
+        if (sampler.enabled()) {
+            cpu.sampler = &sampler;
+        }
+
+        // Components in the order they are stored in a checkpoint
+        vector<Checkpointable *> checkpointed = {&mem, &cache};
+        if (mmu) {
+            checkpointed.push_back(mmu.get());
+        }
+        checkpointed.push_back(&cpu);
+        if (config.checkpoint_restore) {
+            checkpoint_restore(config.checkpoint_restore, checkpointed);
+        }
+        if (config.checkpoint_save) {
+            cpu.checkpoint_at = config.checkpoint_at;
+            cpu.take_checkpoint = [&]() {
+                checkpoint_save(config.checkpoint_save, checkpointed);
+                cout << "Checkpoint written to " << config.checkpoint_save
+                     << " after " << config.checkpoint_at << " accesses" << endl;
+            };
+        }
 
         // Connecting module ports with signals
 
@@ -405,10 +399,29 @@ int sc_main(int argc, char *argv[]) {
         mem.Port_Data(sigCacheData);
         mem.Port_Done(sigCacheDone);
 
-        cache.Port_Func(sigMemFunc);
-        cache.Port_Addr(sigMemAddr);
-        cache.Port_Data(sigMemData);
-        cache.Port_Done(sigMemDone);
+        if (mmu) {
+            mmu->Port_Func(sigMemFunc);
+            mmu->Port_Addr(sigMemAddr);
+            mmu->Port_Data(sigMemData);
+            mmu->Port_Done(sigMemDone);
+
+            mmu->Port_MemFunc(sigPhysFunc);
+            mmu->Port_MemAddr(sigPhysAddr);
+            mmu->Port_MemData(sigPhysData);
+            mmu->Port_MemDone(sigPhysDone);
+
+            cache.Port_Func(sigPhysFunc);
+            cache.Port_Addr(sigPhysAddr);
+            cache.Port_Data(sigPhysData);
+            cache.Port_Done(sigPhysDone);
+
+            mmu->Port_CLK(clk);
+        } else {
+            cache.Port_Func(sigMemFunc);
+            cache.Port_Addr(sigMemAddr);
+            cache.Port_Data(sigMemData);
+            cache.Port_Done(sigMemDone);
+        }
 
         cpu.Port_MemFunc(sigMemFunc);
         cpu.Port_MemAddr(sigMemAddr);
@@ -423,10 +436,24 @@ int sc_main(int argc, char *argv[]) {
 
 
         // Start Simulation
+        if (config.profile) {
+            KernelProfile::enable();
+        }
         sc_start();
 
         // Print statistics after simulation finished
         stats_print();
+        KernelProfile::print();
+        MissClassifier::print_cpus({{cache.cpuid, &cache.misses()}});
+        SyncStats::print_cpus({{cpu.cpuid, &cpu.sync}});
+        cache.flush_write_combining();
+        cache.print_stats();
+        if (mmu) {
+            mmu->print_stats();
+        }
+        if (sampler.enabled()) {
+            sampler.print();
+        }
         // mem.dump(); // Uncomment to dump memory to stdout.
     }
 
@@ -0,0 +1,1056 @@
+/*
+ * File: cache.h
+ *
+ * The cache of a CPU: set-associative lines with LRU replacement, and the
+ * options of the cache modes (set index functions, a victim cache, BDI
+ * compression, write policies and sectored lines), with the statistics of
+ * each.
+ *
+ * Author(s): Michiel W. van Tol, Mike Lankamp, Jony Zhang,
+ *            Konstantinos Bousias, Simon Polstra
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <list>
+#include <memory>
+#include <optional>
+#include "memory.h"
+#include "compression.h"
+#include "conflict.h"
+#include "miss_class.h"
+#include "sector.h"
+#include "write_policy.h"
+
+// Compressed cache mode: tags per set relative to the data ways, and the
+// allocation unit of the data store in bytes.
+static constexpr size_t COMPRESSED_TAG_FACTOR = 2;
+static constexpr size_t COMPRESSION_SEGMENT = 8;
+
+struct Cacheline {
+    using Data = array<uint32_t, CACHE_LINE_SIZE / sizeof(ADDRESS_UNIT)>;
+
+    size_t _idx;
+    size_t tag = 0;
+    bool valid = false;
+    bool dirty = false;
+    uint64_t last_use = 0; // replacement age when the ways are skewed
+    size_t size = CACHE_LINE_SIZE; // bytes taken in the data store
+    Data data {};
+
+    // Sectored lines only: a valid and a dirty bit per sector, and the data
+    // of every sector instead of data. dirty tells whether any sector is.
+    uint32_t valid_sectors = 0;
+    uint32_t dirty_sectors = 0;
+    vector<Data> sectors {};
+};
+
+struct Cacheset {
+    list<Cacheline> lines {};
+
+    Cacheset(){
+        for(size_t way =0; way<CACHE_WAYS; ++way){
+            Cacheline line{way};
+            lines.emplace_back(line);
+        }
+    }
+
+    // Adds tags beyond the data ways, for the compressed cache mode.
+    void add_ways(size_t n)
+    {
+        size_t idx = lines.size();
+        for (size_t i = 0; i < n; ++i) {
+            Cacheline line{idx + i};
+            lines.emplace_back(line);
+        }
+    }
+
+    void touch(Cacheline& way)
+    {
+        auto iter = find_if(lines.begin(), lines.end(), [&](Cacheline& e){return &e == &way;});
+        if(iter == lines.end())
+            return;
+        lines.splice(lines.begin(), lines, iter);
+    }
+    Cacheline& evict()
+    {
+        return lines.back();
+    }
+
+    Cacheline* way(size_t idx)
+    {
+        for (Cacheline& line : lines) {
+            if (line._idx == idx)
+                return &line;
+        }
+        return nullptr;
+    }
+
+    Cacheline* lookup(size_t tag)
+    {
+        for (Cacheline& way : lines) {
+            if (way.valid && way.tag == tag)
+                return &way;
+        }
+        return nullptr;
+    }
+
+    // Line to fill on a miss: an invalid way if there is one, else the LRU way.
+    Cacheline& victim()
+    {
+        for (Cacheline& way : lines) {
+            if (!way.valid)
+                return way;
+        }
+        return evict();
+    }
+
+};
+
+/*
+ * Small fully-associative cache holding the lines most recently evicted from
+ * the sets. A line that hits is swapped back into its set, so the victim
+ * cache only catches lines that were thrown out by conflicts in their set.
+ */
+class VictimCache {
+    public:
+    explicit VictimCache(size_t entries) : m_entries(entries) {}
+
+    bool enabled() const { return !m_entries.empty(); }
+    size_t size() const { return m_entries.size(); }
+
+    // Removes the line from the victim cache if it is there.
+    bool take(uint64_t line, Cacheline& out)
+    {
+        for (Entry& e : m_entries) {
+            if (e.valid && e.line == line) {
+                out = e.data;
+                e.valid = false;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Adds an evicted line. Returns whether that pushed out an older line,
+    // which is then stored in evicted.
+    bool insert(uint64_t line, const Cacheline& data, uint64_t& evicted_line, Cacheline& evicted)
+    {
+        Entry* slot = &m_entries[0];
+        for (Entry& e : m_entries) {
+            if (!e.valid) {
+                slot = &e;
+                break;
+            }
+            if (e.last_use < slot->last_use)
+                slot = &e;
+        }
+        bool pushed_out = slot->valid;
+        evicted_line = slot->line;
+        evicted = slot->data;
+        *slot = Entry{line, data, true, ++m_clock};
+        return pushed_out;
+    }
+
+    void save(CheckpointWriter& out) const
+    {
+        out.write((uint64_t)m_entries.size());
+        out.write(m_clock);
+        for (const Entry& e : m_entries) {
+            out.write(e.line);
+            out.write((uint8_t)e.valid);
+            out.write((uint8_t)e.data.dirty);
+            out.write(e.last_use);
+            out.write_bytes(e.data.data.data(), sizeof(e.data.data));
+        }
+    }
+
+    void restore(CheckpointReader& in)
+    {
+        in.expect((uint64_t)m_entries.size(), "the victim cache size");
+        m_clock = in.read<uint64_t>();
+        for (Entry& e : m_entries) {
+            e.line = in.read<uint64_t>();
+            e.valid = in.read<uint8_t>();
+            e.data.valid = e.valid;
+            e.data.dirty = in.read<uint8_t>();
+            e.last_use = in.read<uint64_t>();
+            in.read_bytes(e.data.data.data(), sizeof(e.data.data));
+        }
+    }
+
+    private:
+    struct Entry {
+        uint64_t line = 0;
+        Cacheline data {};
+        bool valid = false;
+        uint64_t last_use = 0;
+    };
+
+    vector<Entry> m_entries;
+    uint64_t m_clock = 0;
+};
+
+struct CacheConfig {
+    IndexFunction index = INDEX_MODULO;
+    size_t victim_entries = 0; // zero disables the victim cache
+
+    // BDI compressed lines with a decoupled tag and data store
+    bool compression = false;
+    unsigned decompression_latency = 1;
+
+    // Write policy: write-back or write-through, write-allocate or not, and
+    // the number of write-combining buffer entries for stores sent to memory
+    bool write_through = false;
+    bool write_allocate = true;
+    size_t write_combining = 0;
+
+    // Sets listed in the per-set miss classification, zero for all
+    size_t miss_sets = 8;
+
+    // Sectors of CACHE_LINE_SIZE bytes per line. One tag covers them all,
+    // with a valid and dirty bit per sector; the number of sets shrinks to
+    // keep the capacity the same.
+    size_t sectors = 1;
+};
+
+PROFILED_MODULE(Cache), public FunctionalIf, public Checkpointable {
+    public:
+    sc_in<bool> Port_CLK;
+
+    sc_in<Memory::Function> Port_Func;
+    sc_out<Memory::RetCode> Port_Done;
+
+    sc_in<uint64_t> Port_Addr;
+    sc_inout_rv<sizeof(ADDRESS_UNIT) * 32> Port_Data;
+
+    sc_out<Memory::Function> Port_MemFunc;
+    sc_in<Memory::RetCode> Port_MemDone;
+
+    sc_out<uint64_t> Port_MemAddr;
+    sc_inout_rv<sizeof(ADDRESS_UNIT) * 32> Port_MemData;
+
+    // CPU whose statistics this cache updates
+    uint32_t cpuid = 0;
+
+    SC_HAS_PROCESS(Cache);
+
+    Cache(sc_module_name name, const CacheConfig& config = CacheConfig())
+    : ProfiledModule(name), m_config(config), m_indexer(config.index, CACHE_SETS / config.sectors),
+      m_victims(config.victim_entries),
+      m_combining(config.write_combining, CACHE_LINE_SIZE),
+      m_misses(CACHE_SETS / config.sectors, CACHE_WAYS * config.sectors) {
+        SC_THREAD(execute);
+        sensitive << Port_CLK.pos();
+        dont_initialize();
+
+        if (sectored()) {
+            if (config.index != INDEX_MODULO || m_victims.enabled() || config.compression)
+                throw runtime_error("Error, sectored lines need modulo indexing, "
+                                    "without a victim cache or compression");
+            while ((1u << m_sector_bits) < config.sectors)
+                m_sector_bits++;
+            m_sector_stats = make_unique<SectorStats>(config.sectors, CACHE_LINE_SIZE);
+        }
+
+        if (config.index != INDEX_MODULO || m_victims.enabled())
+            m_conflicts = make_unique<ConflictMonitor>(CACHE_SETS, CACHE_WAYS);
+
+        if (config.compression) {
+            if (m_indexer.skewed())
+                throw runtime_error("Error, compression does not support skewed ways");
+            for (Cacheset& set : m_cache)
+                set.add_ways(CACHE_WAYS * (COMPRESSED_TAG_FACTOR - 1));
+            m_compression = make_unique<CompressionStats>(CACHE_SETS, CACHE_WAYS);
+        }
+    }
+
+    // Functional access: updates tags, dirty bits and LRU order only.
+    // Dirty victims are dropped without a write back, and lines are filled
+    // with zeros, as memory returns for most addresses. Counted accesses
+    // update the miss classification, but not the memory traffic.
+    bool functional_access(Memory::Function f, uint64_t addr, bool count) override
+    {
+        uint64_t line = addr >> OFFSET_BITS;
+        size_t index;
+        bool write = f != Memory::FUNC_READ;
+        count = count && stats_get_enabled();
+        if (count)
+            m_accesses++;
+        if (f == Memory::FUNC_ATOMIC)
+            invalidate_peers(line);
+
+        Cacheline* way = find(line, index);
+        bool hit = way != nullptr;
+        if (!hit) {
+            Cacheline from;
+            if (m_victims.enabled() && m_victims.take(line, from)) {
+                way = swap_in(line, from, index, 0, false);
+                hit = true;
+                if (count)
+                    m_victim_hits++;
+            } else if (f == Memory::FUNC_WRITE && !m_config.write_allocate) {
+                m_misses.access(line, set_of(line), cpuid, true, false, count);
+                if (m_conflicts)
+                    m_conflicts->access(line, false, count);
+                if (m_compression)
+                    m_compression->access(line, false, m_resident, count);
+                return false;
+            } else {
+                Cacheline::Data data {};
+                way = fill_sector(line, index, data, false, count);
+                if (!way) {
+                    size_t size = stored_size(data, count);
+                    way = &allocate(line, size, index, 0, false);
+                    fill(*way, line, data, false, size);
+                }
+            }
+        }
+        if (write && !m_config.write_through)
+            set_dirty(*way, line);
+        touch(index, *way);
+        m_misses.access(line, set_of(line), cpuid, write, hit, count);
+        if (m_conflicts)
+            m_conflicts->access(line, hit, count);
+        if (m_compression)
+            m_compression->access(line, hit, m_resident, count);
+        return hit;
+    }
+
+    // Classifier of the misses of this cache, for the per-CPU table
+    const MissClassifier& misses() const { return m_misses; }
+
+    // Finds coherence misses against the writes of the other caches.
+    void share(SharingTracker& sharing) { m_misses.sharing = &sharing; }
+
+    // Adds a cache whose copy of a line an atomic access of this cache
+    // invalidates. Plain reads and writes are not kept coherent.
+    void add_peer(Cache& peer) { m_peers.push_back(&peer); }
+
+    // Called with the address of every dirty line or sector that a
+    // functional access evicts, if set. Otherwise their data is dropped.
+    function<void(uint64_t)> functional_write_back;
+
+    // Drops the line, if present, because another cache takes it
+    // exclusively. A dirty copy moves along with the ownership, so it is
+    // not written back. Returns whether there was a copy.
+    bool invalidate(uint64_t line)
+    {
+        size_t index;
+        Cacheline* way = find(line, index);
+        Cacheline from;
+        if (way && sectored()) {
+            log(name(), "invalidate sector address =", line << OFFSET_BITS, "set =", index, "line =", way->_idx);
+            way->valid_sectors &= ~sector_bit(line);
+            way->dirty_sectors &= ~sector_bit(line);
+            way->dirty = way->dirty_sectors != 0;
+            if (way->valid_sectors == 0) {
+                way->valid = false;
+                m_resident--;
+            }
+        } else if (way) {
+            log(name(), "invalidate line address =", line << OFFSET_BITS, "set =", index, "line =", way->_idx);
+            way->valid = false;
+            m_resident--;
+        } else if (!m_victims.enabled() || !m_victims.take(line, from)) {
+            return false;
+        }
+        if (stats_get_enabled())
+            m_invalidated++;
+        return true;
+    }
+
+    // Counts the stores left in the write-combining buffer at the end of
+    // the run as the combined writes they would become; the simulation has
+    // stopped, so they are not sent.
+    void flush_write_combining()
+    {
+        WriteCombiningBuffer::Entry entry;
+        while (m_combining.take_oldest(entry))
+            count_combined(entry);
+    }
+
+    // Prints the misses per set, the memory traffic, and how many conflict
+    // misses the index function and victim cache removed, if either is
+    // enabled. Runs that only access the cache functionally move no data,
+    // so they leave the traffic out.
+    void print_stats(bool traffic = true) const
+    {
+        m_misses.print_sets(name(), m_config.miss_sets);
+        if (traffic)
+            m_traffic.print(string(name()) + ", " + write_policy(), m_accesses);
+        if (m_sector_stats) {
+            uint64_t lines = 0, sectors = 0;
+            for (const Cacheset& set : m_cache) {
+                for (const Cacheline& way : set.lines) {
+                    lines += way.valid;
+                    sectors += way.valid ? __builtin_popcount(way.valid_sectors) : 0;
+                }
+            }
+            m_sector_stats->print(name(), CACHE_SETS / m_config.sectors * CACHE_WAYS, lines, sectors);
+        }
+        if (!m_peers.empty()) {
+            cout << "Ownership (" << name() << "): " << m_atomics << " atomic accesses, "
+                 << m_upgrades << " upgrades of shared lines, " << m_invalidations
+                 << " copies invalidated in other caches, " << m_invalidated
+                 << " lines invalidated by them" << endl;
+        }
+        if (m_compression)
+            m_compression->print(CACHE_SETS * CACHE_WAYS);
+        if (!m_conflicts)
+            return;
+        string config = string(index_function_name(m_config.index)) + " indexing";
+        if (m_victims.enabled())
+            config += ", " + to_string(m_victims.size()) + " entry victim cache";
+        m_conflicts->print(config.c_str(), m_victim_hits);
+    }
+
+    const char *checkpoint_name() const override { return name(); }
+
+    // Lines are stored per set from most to least recently used, so the
+    // LRU order is restored by rebuilding the lists in the same order.
+    void save(CheckpointWriter &out) const override {
+        out.write(CACHE_SETS);
+        out.write(CACHE_WAYS);
+        out.write(CACHE_LINE_SIZE);
+        out.write((uint64_t)m_config.sectors);
+        out.write((uint8_t)m_config.index);
+        out.write((uint64_t)m_cache[0].lines.size());
+        out.write(m_clock);
+        for (const Cacheset& set : m_cache) {
+            for (const Cacheline& line : set.lines) {
+                out.write((uint32_t)line._idx);
+                out.write((uint64_t)line.tag);
+                out.write((uint8_t)line.valid);
+                out.write((uint8_t)line.dirty);
+                out.write(line.last_use);
+                out.write((uint64_t)line.size);
+                out.write_bytes(line.data.data(), sizeof(line.data));
+                if (sectored()) {
+                    out.write(line.valid_sectors);
+                    out.write(line.dirty_sectors);
+                    // Lines that were never filled have no sectors yet
+                    Cacheline::Data empty {};
+                    for (size_t s = 0; s < m_config.sectors; ++s) {
+                        const Cacheline::Data& data = line.sectors.empty() ? empty : line.sectors[s];
+                        out.write_bytes(data.data(), sizeof(data));
+                    }
+                }
+            }
+        }
+        m_victims.save(out);
+        m_combining.save(out);
+        out.write((uint8_t)(m_conflicts != nullptr));
+        if (m_conflicts)
+            m_conflicts->save(out);
+        if (m_compression)
+            m_compression->save(out);
+        if (m_sector_stats)
+            m_sector_stats->save(out);
+        m_misses.save(out);
+
+        // Statistics, which cover the accesses before the checkpoint too
+        out.write(m_traffic);
+        out.write(m_accesses);
+        out.write(m_victim_hits);
+        out.write(m_atomics);
+        out.write(m_upgrades);
+        out.write(m_invalidations);
+        out.write(m_invalidated);
+    }
+
+    void restore(CheckpointReader &in) override {
+        in.expect(CACHE_SETS, "the number of cache sets");
+        in.expect(CACHE_WAYS, "the number of cache ways");
+        in.expect(CACHE_LINE_SIZE, "the cache line size");
+        in.expect((uint64_t)m_config.sectors, "the number of sectors per line");
+        in.expect((uint8_t)m_config.index, "the index function");
+        size_t tags = m_cache[0].lines.size();
+        in.expect((uint64_t)tags, "the number of tags per set");
+        m_clock = in.read<uint64_t>();
+        m_resident = 0;
+        for (Cacheset& set : m_cache) {
+            set.lines.clear();
+            for (size_t way = 0; way < tags; ++way) {
+                Cacheline line{in.read<uint32_t>()};
+                line.tag = in.read<uint64_t>();
+                line.valid = in.read<uint8_t>();
+                line.dirty = in.read<uint8_t>();
+                line.last_use = in.read<uint64_t>();
+                line.size = in.read<uint64_t>();
+                in.read_bytes(line.data.data(), sizeof(line.data));
+                if (sectored()) {
+                    line.valid_sectors = in.read<uint32_t>();
+                    line.dirty_sectors = in.read<uint32_t>();
+                    line.sectors.resize(m_config.sectors);
+                    for (Cacheline::Data& data : line.sectors)
+                        in.read_bytes(data.data(), sizeof(data));
+                }
+                set.lines.push_back(line);
+                m_resident += line.valid;
+            }
+        }
+        m_victims.restore(in);
+        m_combining.restore(in);
+        in.expect((uint8_t)(m_conflicts != nullptr), "the conflict statistics");
+        if (m_conflicts)
+            m_conflicts->restore(in);
+        if (m_compression)
+            m_compression->restore(in);
+        if (m_sector_stats)
+            m_sector_stats->restore(in);
+        m_misses.restore(in);
+
+        m_traffic = in.read<MemoryTraffic>();
+        m_accesses = in.read<uint64_t>();
+        m_victim_hits = in.read<uint64_t>();
+        m_atomics = in.read<uint64_t>();
+        m_upgrades = in.read<uint64_t>();
+        m_invalidations = in.read<uint64_t>();
+        m_invalidated = in.read<uint64_t>();
+    }
+
+private:
+    array<Cacheset, CACHE_SETS> m_cache;
+    CacheConfig m_config;
+    SetIndexer m_indexer;
+    VictimCache m_victims;
+    unique_ptr<ConflictMonitor> m_conflicts;
+    uint64_t m_clock = 0; // replacement age of the skewed ways
+    uint64_t m_victim_hits = 0;
+    unique_ptr<CompressionStats> m_compression;
+    uint64_t m_resident = 0; // valid lines in the cache
+    WriteCombiningBuffer m_combining;
+    MemoryTraffic m_traffic;
+    uint64_t m_accesses = 0;
+    MissClassifier m_misses;
+    vector<Cache*> m_peers;
+    uint64_t m_atomics = 0;
+    uint64_t m_upgrades = 0;      // atomic hits on lines other caches held too
+    uint64_t m_invalidations = 0; // copies of other caches invalidated
+    uint64_t m_invalidated = 0;   // own lines invalidated by other caches
+    unsigned m_sector_bits = 0;   // log2 of the sectors per line
+    unique_ptr<SectorStats> m_sector_stats;
+
+    bool sectored() const { return m_config.sectors > 1; }
+
+    // Bit of the sector of the line address in the masks of its line
+    uint32_t sector_bit(uint64_t line) const
+    {
+        return 1u << (line & (m_config.sectors - 1));
+    }
+
+    // Set of the line address, for the per-set statistics
+    size_t set_of(uint64_t line) const { return m_indexer.set(line >> m_sector_bits, 0); }
+
+    // Data of the line address in a line that holds it
+    Cacheline::Data& data_of(Cacheline& way, uint64_t line)
+    {
+        return sectored() ? way.sectors[line & (m_config.sectors - 1)] : way.data;
+    }
+
+    void set_dirty(Cacheline& way, uint64_t line)
+    {
+        way.dirty = true;
+        if (sectored())
+            way.dirty_sectors |= sector_bit(line);
+    }
+
+    // Invalidates the copies of the line in the other caches, returns
+    // whether there were any.
+    bool invalidate_peers(uint64_t line)
+    {
+        bool shared = false;
+        for (Cache* peer : m_peers) {
+            if (peer->invalidate(line)) {
+                shared = true;
+                if (stats_get_enabled())
+                    m_invalidations++;
+            }
+        }
+        return shared;
+    }
+
+    // Requests the line from the memory side with the intent to modify it,
+    // for an atomic access to a line that other caches shared. The line is
+    // already here, so the response only completes the upgrade.
+    void upgrade(uint64_t addr)
+    {
+        log(name(), "upgrade address =", addr);
+        Port_MemAddr.write(addr);
+        Port_MemFunc.write(Memory::FUNC_READ);
+        wait(Port_MemDone.value_changed_event());
+        if (stats_get_enabled())
+            m_upgrades++;
+    }
+
+    // Stores the value in a line that is present, for a write or atomic hit.
+    void store(Cacheline& way, size_t index, size_t offset, uint64_t addr, ADDRESS_UNIT value)
+    {
+        data_of(way, addr >> OFFSET_BITS)[offset] = value;
+        if (!m_config.write_through)
+            set_dirty(way, addr >> OFFSET_BITS);
+        if (m_config.compression) {
+            // The line may no longer compress as well
+            size_t size = stored_size(way.data, false);
+            if (size > way.size)
+                make_room(index, size - way.size, &way, offset, true);
+            way.size = size;
+        }
+        if (m_config.write_through)
+            write_memory(addr, value);
+    }
+
+    string write_policy() const
+    {
+        string policy = m_config.write_through ? "write-through" : "write-back";
+        policy += m_config.write_allocate ? ", write-allocate" : ", no-write-allocate";
+        if (m_combining.enabled())
+            policy += ", " + to_string(m_combining.size()) + " entry write-combining buffer";
+        return policy;
+    }
+
+    // Line holding the line address, or nullptr. index is set to the set
+    // that was searched last.
+    Cacheline* find(uint64_t line, size_t& index)
+    {
+        Cacheline* way = find_tag(line, index);
+        if (way && sectored() && !(way->valid_sectors & sector_bit(line)))
+            return nullptr;
+        return way;
+    }
+
+    // Line with the tag of the line address, whether or not a sectored line
+    // holds the sector of the address.
+    Cacheline* find_tag(uint64_t line, size_t& index)
+    {
+        line >>= m_sector_bits;
+        size_t tag = m_indexer.tag(line);
+        if (!m_indexer.skewed()) {
+            index = m_indexer.set(line, 0);
+            return m_cache[index].lookup(tag);
+        }
+        // Every way is indexed with its own hash
+        for (size_t w = 0; w < CACHE_WAYS; ++w) {
+            index = m_indexer.set(line, w);
+            Cacheline* way = m_cache[index].way(w);
+            if (way->valid && way->tag == tag)
+                return way;
+        }
+        return nullptr;
+    }
+
+    // Line to fill for the line address, and the set it is in. With skewed
+    // ways the candidates are spread over sets, so age decides instead of
+    // the per-set LRU order.
+    Cacheline& replace(uint64_t line, size_t& index)
+    {
+        line >>= m_sector_bits;
+        if (!m_indexer.skewed()) {
+            index = m_indexer.set(line, 0);
+            return m_cache[index].victim();
+        }
+        Cacheline* oldest = nullptr;
+        for (size_t w = 0; w < CACHE_WAYS; ++w) {
+            size_t set = m_indexer.set(line, w);
+            Cacheline* way = m_cache[set].way(w);
+            if (!way->valid || !oldest || way->last_use < oldest->last_use) {
+                oldest = way;
+                index = set;
+                if (!way->valid)
+                    break;
+            }
+        }
+        return *oldest;
+    }
+
+    void touch(size_t index, Cacheline& way)
+    {
+        way.last_use = ++m_clock;
+        m_cache[index].touch(way);
+    }
+
+    // Line address of the line, of its first sector if it is sectored
+    uint64_t line_of(const Cacheline& way, size_t index) const
+    {
+        return m_indexer.line(way.tag, index) << m_sector_bits;
+    }
+
+    void write_back(uint64_t line_addr, ADDRESS_UNIT data)
+    {
+        Port_MemAddr.write(line_addr);
+        Port_MemData.write(data);
+        wait(); // HACK: Find out the reason why this happens.
+                // Some sort of race condition, just the question is why.
+        Port_MemFunc.write(Memory::FUNC_WRITE);
+        wait(Port_MemDone.value_changed_event());
+        Port_MemData.write(float_64_bit_wire);
+    }
+
+    // Removes a valid line from its set. The victim cache takes it if there
+    // is one, otherwise a dirty line is written back. Untimed evictions of
+    // the functional path go to functional_write_back, or drop dirty data
+    // if it is not set.
+    void evict(size_t index, Cacheline& way, size_t offset, bool timed)
+    {
+        uint64_t victim_line_addr = line_of(way, index) << OFFSET_BITS;
+        uint64_t dropped_line;
+        Cacheline dropped;
+        bool writes = timed || functional_write_back;
+        if (m_victims.enabled()) {
+            // The victim cache takes the line; write back what it pushes out.
+            log(name(), "move line to victim cache address =", victim_line_addr, "set =", index, "line =", way._idx);
+            if (m_victims.insert(line_of(way, index), way, dropped_line, dropped) && dropped.dirty && writes) {
+                log(name(), "evict dirty line from victim cache address =", dropped_line << OFFSET_BITS);
+                write_back_evicted(dropped_line << OFFSET_BITS, dropped.data[offset], timed);
+            }
+        } else if (way.dirty && writes && sectored()) {
+            // Only the dirty sectors go back to memory
+            for (size_t s = 0; s < m_config.sectors; ++s) {
+                if (!(way.dirty_sectors & (1u << s)))
+                    continue;
+                uint64_t sector_addr = victim_line_addr + s * CACHE_LINE_SIZE;
+                log(name(), "evict dirty sector address =", sector_addr, "set =", index, "line =", way._idx);
+                write_back_evicted(sector_addr, way.sectors[s][offset], timed);
+            }
+        } else if (way.dirty && writes) {
+            log(name(), "evict dirty line address =", victim_line_addr, "set =", index, "line =", way._idx);
+            write_back_evicted(victim_line_addr, way.data[offset], timed);
+        } else {
+            log(name(), "evict clean line address =", victim_line_addr, "set =", index, "line =", way._idx);
+        }
+        if (m_sector_stats && stats_get_enabled())
+            m_sector_stats->evict(__builtin_popcount(way.valid_sectors), way.dirty && timed);
+        way.valid = false;
+        m_resident--;
+    }
+
+    // Writes an evicted dirty line or sector back to memory, or hands it to
+    // functional_write_back when the eviction is untimed.
+    void write_back_evicted(uint64_t addr, ADDRESS_UNIT data, bool timed)
+    {
+        if (!timed) {
+            functional_write_back(addr);
+            return;
+        }
+        count_write_back();
+        write_back(addr, data);
+    }
+
+    void count_write_back()
+    {
+        if (stats_get_enabled()) {
+            m_traffic.write_backs++;
+            m_traffic.write_bytes += CACHE_LINE_SIZE;
+            if (m_sector_stats)
+                m_sector_stats->write_back();
+        }
+    }
+
+    // Sends a store to memory for write-through and no-write-allocate,
+    // through the write-combining buffer if there is one.
+    void write_memory(uint64_t addr, ADDRESS_UNIT data)
+    {
+        if (!m_combining.enabled()) {
+            if (stats_get_enabled()) {
+                m_traffic.stores++;
+                m_traffic.write_bytes += STORE_BYTES;
+            }
+            log(name(), "write through address =", addr);
+            write_back(addr, data);
+            return;
+        }
+        WriteCombiningBuffer::Entry entry;
+        if (m_combining.store(addr, data, CACHE_LINE_SIZE, entry))
+            write_combined(entry);
+    }
+
+    void write_combined(const WriteCombiningBuffer::Entry& entry)
+    {
+        count_combined(entry);
+        log(name(), "write combined line address =", entry.line * CACHE_LINE_SIZE, "bytes =", entry.bytes());
+        write_back(entry.addr, entry.data);
+    }
+
+    void count_combined(const WriteCombiningBuffer::Entry& entry)
+    {
+        if (stats_get_enabled()) {
+            m_traffic.combined++;
+            m_traffic.write_bytes += entry.bytes();
+        }
+    }
+
+    // Evicts lines other than keep, least recently used first, until the
+    // set has room for size more data bytes and, unless keep is given, a
+    // free tag.
+    void make_room(size_t index, size_t size, Cacheline* keep, size_t offset, bool timed)
+    {
+        Cacheset& set = m_cache[index];
+        while (true) {
+            size_t used = 0;
+            size_t tags = 0;
+            for (Cacheline& way : set.lines) {
+                if (way.valid) {
+                    used += way.size;
+                    tags++;
+                }
+            }
+            if (used + size <= CACHE_WAYS * CACHE_LINE_SIZE && (keep || tags < set.lines.size()))
+                return;
+            for (auto it = set.lines.rbegin(); it != set.lines.rend(); ++it) {
+                if (it->valid && &*it != keep) {
+                    evict(index, *it, offset, timed);
+                    break;
+                }
+            }
+        }
+    }
+
+    // Way to fill with a line that takes size bytes of data. Without
+    // compression this is the replacement victim, with compression as many
+    // lines are evicted as needed to free a tag and enough data segments.
+    Cacheline& allocate(uint64_t line, size_t size, size_t& index, size_t offset, bool timed)
+    {
+        if (m_config.compression) {
+            index = m_indexer.set(line, 0);
+            make_room(index, size, nullptr, offset, timed);
+        }
+        Cacheline& way = replace(line, index);
+        if (way.valid)
+            evict(index, way, offset, timed);
+        return way;
+    }
+
+    void fill(Cacheline& way, uint64_t line, const Cacheline::Data& data, bool dirty, size_t size)
+    {
+        way.tag = m_indexer.tag(line >> m_sector_bits);
+        way.valid = true;
+        way.dirty = dirty;
+        way.size = size;
+        m_resident++;
+        if (!sectored()) {
+            way.data = data;
+            return;
+        }
+        way.sectors.assign(m_config.sectors, Cacheline::Data {});
+        way.valid_sectors = 0;
+        way.dirty_sectors = 0;
+        fill_sector(way, line, data, dirty);
+    }
+
+    void fill_sector(Cacheline& way, uint64_t line, const Cacheline::Data& data, bool dirty)
+    {
+        data_of(way, line) = data;
+        way.valid_sectors |= sector_bit(line);
+        if (dirty)
+            set_dirty(way, line);
+    }
+
+    // Fills the sector of the line address if a sectored line has the tag
+    // but not the sector, without replacing any line. Returns that line, or
+    // nullptr when the tag missed too and a line has to be allocated.
+    Cacheline* fill_sector(uint64_t line, size_t& index, const Cacheline::Data& data, bool dirty, bool count)
+    {
+        if (!sectored())
+            return nullptr;
+        Cacheline* way = find_tag(line, index);
+        if (count) {
+            if (way)
+                m_sector_stats->sector_miss();
+            else
+                m_sector_stats->tag_miss();
+            m_sector_stats->fill();
+        }
+        if (way)
+            fill_sector(*way, line, data, dirty);
+        return way;
+    }
+
+    // Bytes of the data store that the line takes: its BDI compressed size
+    // rounded up to whole segments, or a full way without compression.
+    size_t stored_size(const Cacheline::Data& data, bool count_fill)
+    {
+        if (!m_config.compression)
+            return CACHE_LINE_SIZE;
+        uint8_t bytes[CACHE_LINE_SIZE];
+        for (size_t i = 0; i < CACHE_LINE_SIZE; ++i)
+            bytes[i] = data[i];
+        BdiResult r = bdi_compress(bytes, CACHE_LINE_SIZE);
+        if (count_fill)
+            m_compression->fill(r, CACHE_LINE_SIZE, stats_get_enabled());
+        return (r.size + COMPRESSION_SEGMENT - 1) / COMPRESSION_SEGMENT * COMPRESSION_SEGMENT;
+    }
+
+    // Moves a line that hit in the victim cache back into its set. The line
+    // it replaces takes its place in the victim cache.
+    Cacheline* swap_in(uint64_t line, const Cacheline& from, size_t& index, size_t offset, bool timed)
+    {
+        size_t size = stored_size(from.data, false);
+        Cacheline& way = allocate(line, size, index, offset, timed);
+        fill(way, line, from.data, from.dirty, size);
+        return &way;
+    }
+
+    void write_out_read(ADDRESS_UNIT data)
+    {
+        Port_Data.write(data);
+        Port_Done.write(Memory::RET_READ_DONE);
+        wait();
+        Port_Data.write(float_64_bit_wire); // string with 64 "Z"'s
+    }
+
+    void execute()
+    {
+        while (true) {
+            wait(Port_Func.value_changed_event());
+
+            Memory::Function f = Port_Func.read();
+            uint64_t addr = Port_Addr.read();
+            std::optional<uint32_t> result; // result will be gone if we not gonna take it instantly.
+            bool write = f != Memory::FUNC_READ; // atomics write too
+
+            if (write)
+                result = Port_Data.read().to_uint();
+
+            size_t offset = addr & ((1 << OFFSET_BITS) - 1); // offset bitmask -> indicates which offset in cacheline we select.
+            uint64_t line = addr >> OFFSET_BITS; // the set and the tag are derived from the line address
+            size_t index;
+
+            if (f == Memory::FUNC_READ)
+                log(name(), "read address =", addr);
+            if (f == Memory::FUNC_WRITE)
+                log(name(), "write address =", addr);
+            if (f == Memory::FUNC_ATOMIC) {
+                log(name(), "atomic address =", addr);
+                if (stats_get_enabled())
+                    m_atomics++;
+            }
+
+            wait(1);
+
+            // An atomic access needs the only copy of the line
+            bool shared = f == Memory::FUNC_ATOMIC && invalidate_peers(line);
+
+            Cacheline* way = find(line, index);
+            Cacheline from;
+            if (!way && m_victims.enabled() && m_victims.take(line, from)) {
+                // One more cycle to swap the line back into its set
+                wait(1);
+                way = swap_in(line, from, index, offset, true);
+                if (stats_get_enabled())
+                    m_victim_hits++;
+                log(name(), "victim cache hit address =", addr, "set =", index);
+            }
+            m_misses.access(line, set_of(line), cpuid, write,
+                            way != nullptr, stats_get_enabled());
+            if (m_conflicts)
+                m_conflicts->access(line, way != nullptr, stats_get_enabled());
+            if (m_compression)
+                m_compression->access(line, way != nullptr, m_resident, stats_get_enabled());
+            if (stats_get_enabled())
+                m_accesses++;
+
+            if (way) {
+                // fast path
+                // touch line to make sure it's recently used.
+                touch(index, *way);
+                if (m_config.compression && way->size < CACHE_LINE_SIZE)
+                    wait(m_config.decompression_latency);
+                if (f == Memory::FUNC_READ) {
+                    log(name(), "read hit address =", addr, "set =", index, "line =", way->_idx);
+                    stats_readhit(cpuid);
+                    write_out_read(data_of(*way, line)[offset]);
+                }
+                if (f == Memory::FUNC_WRITE) {
+                    log(name(), "write hit address =", addr, "set =", index, "line =", way->_idx);
+                    store(*way, index, offset, addr, result.value());
+                    Port_Done.write(Memory::RET_WRITE_DONE);
+                    stats_writehit(cpuid);
+                }
+                if (f == Memory::FUNC_ATOMIC) {
+                    log(name(), "atomic hit address =", addr, "set =", index, "line =", way->_idx);
+                    if (shared)
+                        upgrade(addr);
+                    ADDRESS_UNIT old = data_of(*way, line)[offset];
+                    store(*way, index, offset, addr, result.value());
+                    stats_writehit(cpuid);
+                    write_out_read(old);
+                }
+                continue;
+            }
+
+            if (f == Memory::FUNC_READ) {
+                stats_readmiss(cpuid);
+                log(name(), "read miss address =", addr);
+            } else {
+                stats_writemiss(cpuid);
+                log(name(), f == Memory::FUNC_WRITE ? "write miss address =" : "atomic miss address =", addr);
+            }
+
+            if (f == Memory::FUNC_WRITE && !m_config.write_allocate) {
+                // Send the store on without fetching the line
+                write_memory(addr, result.value());
+                Port_Done.write(Memory::RET_WRITE_DONE);
+                log(name(), "write done address =", addr);
+                continue;
+            }
+
+            // A combined write of this line has to reach memory first
+            WriteCombiningBuffer::Entry combined;
+            if (m_combining.enabled() && m_combining.take(line, combined))
+                write_combined(combined);
+
+            // Taking a slow path. Accessing memory
+
+            Port_MemAddr.write(addr);
+            Port_MemFunc.write(Memory::FUNC_READ);
+            wait(Port_MemDone.value_changed_event());
+            if (stats_get_enabled()) {
+                m_traffic.fills++;
+                m_traffic.read_bytes += CACHE_LINE_SIZE;
+            }
+
+            // The old value, for reads and atomics
+            uint32_t fetched = 0;
+            if (f != Memory::FUNC_WRITE)
+                fetched = Port_MemData.read().to_uint();
+            if (f == Memory::FUNC_READ)
+                result = fetched;
+
+            // The new line holds the accessed byte, the rest reads as zero
+            Cacheline::Data data {};
+            data[offset] = result.value();
+            bool dirty = write && !m_config.write_through;
+            Cacheline* assign_way = fill_sector(line, index, data, dirty, stats_get_enabled());
+            if (!assign_way) {
+                size_t size = stored_size(data, true);
+                assign_way = &allocate(line, size, index, offset, true);
+
+                // Overwrite and put it to the front
+                fill(*assign_way, line, data, dirty, size);
+            }
+            touch(index, *assign_way);
+
+            log(name(), "write completed address =", addr, "set =", index, "line =", assign_way->_idx);
+
+            if (f == Memory::FUNC_READ) {
+                write_out_read(result.value());
+                log(name(), "read done address =", addr);
+            } else {
+                if (m_config.write_through)
+                    write_memory(addr, result.value());
+                if (f == Memory::FUNC_ATOMIC)
+                    write_out_read(fetched);
+                else
+                    Port_Done.write(Memory::RET_WRITE_DONE);
+                log(name(), "write done address =", addr);
+            }
+        }
+    }
+};
+
+#endif
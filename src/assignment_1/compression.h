@@ -0,0 +1,207 @@
+/*
+ * File: compression.h
+ *
+ * Base-Delta-Immediate line compression (Pekhimenko et al., PACT 2012) and
+ * the statistics of the compressed cache mode. A line is stored as one base
+ * and a small delta per value, where every value is relative either to the
+ * base or to zero (the immediate). Lines of zeros and lines of one repeated
+ * 8-byte value have their own encodings.
+ *
+ * The traces carry no data, so the simulated lines only hold the values the
+ * CPUs stored; everything else reads as zero. The ratios reported are an
+ * upper bound from this data model, not a property of the workload.
+ */
+
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include "checkpoint.h"
+#include "conflict.h"
+
+enum BdiEncoding {
+    BDI_ZEROS, BDI_REPEATED, BDI_B8D1, BDI_B8D2, BDI_B8D4, BDI_B4D1, BDI_B4D2,
+    BDI_B2D1, BDI_UNCOMPRESSED, BDI_ENCODINGS
+};
+
+static inline const char *bdi_encoding_name(BdiEncoding e) {
+    static const char *names[] = {"zeros", "repeated", "base8-delta1",
+                                  "base8-delta2", "base8-delta4", "base4-delta1",
+                                  "base4-delta2", "base2-delta1", "uncompressed"};
+    return names[e];
+}
+
+struct BdiResult {
+    BdiEncoding encoding;
+    size_t size; // bytes
+};
+
+namespace bdi_detail {
+
+// Little-endian value of k bytes, sign-extended
+static inline int64_t value(const uint8_t *p, size_t k) {
+    uint64_t v = 0;
+    memcpy(&v, p, k);
+    unsigned shift = 64 - 8 * k;
+    return (int64_t)(v << shift) >> shift;
+}
+
+static inline bool fits(int64_t v, size_t d) {
+    int64_t limit = 1LL << (8 * d - 1);
+    return v >= -limit && v < limit;
+}
+
+// Size of the line with base size k and delta size d, or 0 if it does not fit
+static inline size_t base_delta(const uint8_t *line, size_t bytes, size_t k, size_t d) {
+    size_t n = bytes / k;
+    bool have_base = false;
+    int64_t base = 0;
+    for (size_t i = 0; i < n; i++) {
+        int64_t v = value(line + i * k, k);
+        if (fits(v, d)) {
+            continue; // immediate, relative to zero
+        }
+        if (!have_base) {
+            base = v;
+            have_base = true;
+        }
+        if (!fits(v - base, d)) {
+            return 0;
+        }
+    }
+    // base, one delta per value and one bit per value to select the base
+    return k + n * d + (n + 7) / 8;
+}
+
+} // namespace bdi_detail
+
+static inline BdiResult bdi_compress(const uint8_t *line, size_t bytes) {
+    using namespace bdi_detail;
+    BdiResult best = {BDI_UNCOMPRESSED, bytes};
+
+    bool zeros = true;
+    bool repeated = bytes % 8 == 0;
+    for (size_t i = 0; i < bytes; i++) {
+        zeros = zeros && line[i] == 0;
+        repeated = repeated && line[i] == line[i % 8];
+    }
+    if (zeros) {
+        return {BDI_ZEROS, 1};
+    }
+    if (repeated) {
+        best = {BDI_REPEATED, 8};
+    }
+
+    static const struct { BdiEncoding e; size_t k, d; } configs[] = {
+        {BDI_B8D1, 8, 1}, {BDI_B8D2, 8, 2}, {BDI_B8D4, 8, 4},
+        {BDI_B4D1, 4, 1}, {BDI_B4D2, 4, 2}, {BDI_B2D1, 2, 1}};
+    for (auto &c : configs) {
+        size_t size = bytes % c.k == 0 ? base_delta(line, bytes, c.k, c.d) : 0;
+        if (size && size < best.size) {
+            best = {c.e, size};
+        }
+    }
+    return best;
+}
+
+/*
+ * Statistics of the compressed cache: the compression ratio of the lines
+ * filled into the cache, the number of lines resident compared with the
+ * physical capacity, and the hit rate of an uncompressed LRU cache of the
+ * same geometry.
+ */
+class CompressionStats {
+    public:
+    CompressionStats(size_t sets, size_t ways) : m_baseline(sets, ways) {}
+
+    void fill(const BdiResult &r, size_t line_size, bool count) {
+        if (!count) {
+            return;
+        }
+        m_fills++;
+        m_original += line_size;
+        m_compressed += r.size;
+        m_encodings[r.encoding]++;
+    }
+
+    // Records an access of the compressed cache with the number of valid
+    // lines it held at that time.
+    void access(uint64_t line, bool hit, uint64_t resident, bool count) {
+        bool base_hit = m_baseline.access(line);
+        if (!count) {
+            return;
+        }
+        m_accesses++;
+        m_hits += hit;
+        m_base_hits += base_hit;
+        m_resident += resident;
+    }
+
+    void print(size_t physical_lines) const {
+        using namespace std;
+        cout << "Compression (BDI):" << endl;
+        cout << "  The traces carry no data: lines hold the stored values and zeros,"
+             << " so the ratios are an upper bound" << endl;
+        cout << "  Compression ratio: "
+             << (m_compressed ? (double)m_original / m_compressed : 1.0)
+             << " over " << m_fills << " filled lines" << endl;
+        cout << "  Encodings:";
+        for (int e = 0; e < BDI_ENCODINGS; e++) {
+            if (m_encodings[e]) {
+                cout << " " << bdi_encoding_name((BdiEncoding)e) << " "
+                     << m_encodings[e];
+            }
+        }
+        cout << endl;
+        double resident = m_accesses ? (double)m_resident / m_accesses : 0.0;
+        cout << "  Effective capacity: " << resident << " lines on average, "
+             << resident / physical_lines << "x the " << physical_lines
+             << " physical lines" << endl;
+        if (m_accesses) {
+            cout << "  Hit rate: " << 100.0 * m_hits / m_accesses
+                 << "%, uncompressed " << 100.0 * m_base_hits / m_accesses
+                 << "%" << endl;
+        }
+    }
+
+    void save(CheckpointWriter &out) const {
+        m_baseline.save(out);
+        out.write(m_fills);
+        out.write(m_original);
+        out.write(m_compressed);
+        out.write_bytes(m_encodings, sizeof(m_encodings));
+        out.write(m_accesses);
+        out.write(m_hits);
+        out.write(m_base_hits);
+        out.write(m_resident);
+    }
+
+    void restore(CheckpointReader &in) {
+        m_baseline.restore(in);
+        m_fills = in.read<uint64_t>();
+        m_original = in.read<uint64_t>();
+        m_compressed = in.read<uint64_t>();
+        in.read_bytes(m_encodings, sizeof(m_encodings));
+        m_accesses = in.read<uint64_t>();
+        m_hits = in.read<uint64_t>();
+        m_base_hits = in.read<uint64_t>();
+        m_resident = in.read<uint64_t>();
+    }
+
+    private:
+    SetAssocLru m_baseline;
+
+    uint64_t m_fills = 0;
+    uint64_t m_original = 0;
+    uint64_t m_compressed = 0;
+    uint64_t m_encodings[BDI_ENCODINGS] = {};
+    uint64_t m_accesses = 0;
+    uint64_t m_hits = 0;
+    uint64_t m_base_hits = 0;
+    uint64_t m_resident = 0;
+};
+
+#endif
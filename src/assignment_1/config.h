@@ -0,0 +1,70 @@
+/*
+ * File: config.h
+ *
+ * Options of a simulation run, as parsed from the command line, and the run
+ * modes that sc_main dispatches to besides the single-core simulation.
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <memory>
+#include "cache.h"
+#include "network.h"
+#include "ooo.h"
+#include "tlb.h"
+
+struct Config {
+    // Statistical sampling, disabled when the interval is zero
+    uint64_t sample_interval = 0;
+    uint64_t sample_size = 1000;
+    uint64_t sample_warmup = 0;
+
+    // Functional warming before the detailed simulation starts
+    uint64_t fast_forward = 0;
+
+    // Checkpoint to write after checkpoint_at accesses, and checkpoint to
+    // start from
+    const char *checkpoint_save = nullptr;
+    uint64_t checkpoint_at = 0;
+    const char *checkpoint_restore = nullptr;
+
+    // Address translation between the CPU and the cache
+    TlbConfig tlb;
+
+    // Set index function, victim cache, compression and write policy
+    CacheConfig cache;
+
+    // Multi-core mode: one CPU and cache per trace, connected over a mesh
+    // network to the LLC banks
+    bool noc = false;
+    NocConfig mesh;
+    LlcConfig llc;
+
+    // Single-CPU tracefiles to run next to the main one, each on its own
+    // core, and the IPC proxy of every program when it runs alone
+    vector<string> programs;
+    vector<double> alone_ipc;
+
+    // Out-of-order core instead of the blocking CPU
+    OooConfig ooo;
+
+    // Count thread resumes, signal writes and host time per module
+    bool profile = false;
+
+    // Tracefile to write the misses and write-backs of the caches to,
+    // instead of simulating
+    string filter;
+};
+
+// Multi-core mode, network.cpp
+vector<unique_ptr<TraceFile>> open_programs(const Config& config);
+void run_noc(const Config& config, const vector<unique_ptr<TraceFile>>& programs);
+
+// Out-of-order core, ooo_cpu.cpp
+void run_ooo(const Config& config);
+
+// Filter stage, filter.cpp
+void run_filter(const Config& config);
+
+#endif
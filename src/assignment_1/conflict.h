@@ -0,0 +1,309 @@
+/*
+ * File: conflict.h
+ *
+ * Set index functions that spread power-of-two strides over the sets of the
+ * cache, and a monitor that counts the conflict misses of the configured
+ * cache against the plain modulo-indexed cache. A miss is a conflict miss
+ * when a fully-associative LRU cache of the same capacity would have hit.
+ */
+
+#ifndef CONFLICT_H
+#define CONFLICT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "checkpoint.h"
+#include "line_table.h"
+
+enum IndexFunction { INDEX_MODULO, INDEX_XOR, INDEX_PRIME, INDEX_SKEWED };
+
+static inline IndexFunction parse_index_function(const std::string &name) {
+    if (name == "modulo") return INDEX_MODULO;
+    if (name == "xor") return INDEX_XOR;
+    if (name == "prime") return INDEX_PRIME;
+    if (name == "skewed") return INDEX_SKEWED;
+    throw std::runtime_error("Error, unknown index function " + name);
+}
+
+static inline const char *index_function_name(IndexFunction f) {
+    static const char *names[] = {"modulo", "xor", "prime", "skewed"};
+    return names[f];
+}
+
+/*
+ * Maps line addresses (address >> offset bits) to sets.
+ *  - modulo: the low index bits, the classic power-of-two indexing.
+ *  - xor: all index-sized chunks of the line address XOR-ed together.
+ *  - prime: the line address modulo the largest prime not above the number
+ *    of sets, which leaves the remaining sets unused.
+ *  - skewed: every way uses its own hash, the low bits XOR-ed with the
+ *    folded upper bits rotated by the way number, so lines that collide in
+ *    one way are spread over different sets in the others.
+ * Only modulo indexing can rebuild the address from the set, the others keep
+ * the whole line address as the tag.
+ */
+class SetIndexer {
+    public:
+    SetIndexer(IndexFunction function, size_t sets) : m_function(function) {
+        if (sets == 0 || (sets & (sets - 1))) {
+            throw std::runtime_error("Error, the number of sets must be a power of two");
+        }
+        while ((1ULL << m_bits) < sets) {
+            m_bits++;
+        }
+        m_mask = sets - 1;
+        m_prime = sets;
+        while (m_prime > 2 && !is_prime(m_prime)) {
+            m_prime--;
+        }
+    }
+
+    IndexFunction function() const { return m_function; }
+    bool skewed() const { return m_function == INDEX_SKEWED; }
+
+    size_t set(uint64_t line, size_t way) const {
+        switch (m_function) {
+        case INDEX_XOR: return fold(line);
+        case INDEX_PRIME: return line % m_prime;
+        case INDEX_SKEWED: return (line ^ rotate(fold(line >> m_bits), way)) & m_mask;
+        default: return line & m_mask;
+        }
+    }
+
+    uint64_t tag(uint64_t line) const {
+        return m_function == INDEX_MODULO ? line >> m_bits : line;
+    }
+
+    uint64_t line(uint64_t tag, size_t set) const {
+        return m_function == INDEX_MODULO ? (tag << m_bits) | set : tag;
+    }
+
+    private:
+    IndexFunction m_function;
+    unsigned m_bits = 0;
+    uint64_t m_mask;
+    uint64_t m_prime;
+
+    static bool is_prime(uint64_t n) {
+        for (uint64_t d = 2; d * d <= n; d++) {
+            if (n % d == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    uint64_t fold(uint64_t line) const {
+        uint64_t h = 0;
+        for (; line; line >>= m_bits) {
+            h ^= line;
+        }
+        return h & m_mask;
+    }
+
+    uint64_t rotate(uint64_t v, size_t way) const {
+        unsigned r = way % m_bits;
+        return r ? ((v << r) | (v >> (m_bits - r))) & m_mask : v;
+    }
+};
+
+// Fully-associative LRU tag store, used as a shadow of a real cache. The
+// recency order is a doubly linked list threaded through a fixed array of
+// entries, so an access costs one hash lookup and no allocation.
+class LruStack {
+    public:
+    explicit LruStack(size_t capacity) : m_capacity(capacity), m_where(capacity) {
+        m_entries.reserve(capacity);
+    }
+
+    // Returns whether the line was present and makes it the most recent one.
+    bool access(uint64_t line) {
+        if (uint32_t *at = m_where.find(line)) {
+            unlink(*at);
+            push_front(*at);
+            return true;
+        }
+        uint32_t e;
+        if (m_entries.size() < m_capacity) {
+            e = m_entries.size();
+            m_entries.push_back(Entry());
+        } else {
+            e = m_tail;
+            m_where.erase(m_entries[e].line);
+            unlink(e);
+        }
+        m_entries[e].line = line;
+        push_front(e);
+        bool inserted;
+        m_where.insert(line, inserted) = e;
+        return false;
+    }
+
+    void save(CheckpointWriter &out) const {
+        out.write((uint64_t)m_entries.size());
+        for (uint32_t e = m_head; e != NONE; e = m_entries[e].next) {
+            out.write(m_entries[e].line);
+        }
+    }
+
+    void restore(CheckpointReader &in) {
+        m_entries.clear();
+        m_where.clear();
+        m_head = m_tail = NONE;
+        std::vector<uint64_t> lines(in.read<uint64_t>());
+        for (uint64_t &line : lines) {
+            line = in.read<uint64_t>();
+        }
+        // Most recently used first, so insert from the back
+        for (auto it = lines.rbegin(); it != lines.rend(); ++it) {
+            access(*it);
+        }
+    }
+
+    private:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    struct Entry {
+        uint64_t line = 0;
+        uint32_t prev = NONE;
+        uint32_t next = NONE;
+    };
+
+    size_t m_capacity;
+    std::vector<Entry> m_entries;
+    LineTable<uint32_t> m_where;
+    uint32_t m_head = NONE; // most recently used
+    uint32_t m_tail = NONE;
+
+    void unlink(uint32_t e) {
+        Entry &x = m_entries[e];
+        (x.prev == NONE ? m_head : m_entries[x.prev].next) = x.next;
+        (x.next == NONE ? m_tail : m_entries[x.next].prev) = x.prev;
+    }
+
+    void push_front(uint32_t e) {
+        m_entries[e].prev = NONE;
+        m_entries[e].next = m_head;
+        (m_head == NONE ? m_tail : m_entries[m_head].prev) = e;
+        m_head = e;
+    }
+};
+
+// Modulo-indexed set-associative LRU tag store, the shadow of a plain cache.
+class SetAssocLru {
+    public:
+    SetAssocLru(size_t sets, size_t ways) : m_ways(ways), m_lines(sets * ways, 0) {}
+
+    // Returns whether the line was present and makes it the most recent one.
+    bool access(uint64_t line) {
+        size_t sets = m_lines.size() / m_ways;
+        auto first = m_lines.begin() + (line % sets) * m_ways;
+        auto last = first + m_ways;
+        auto it = std::find(first, last, line + 1);
+        bool hit = it != last;
+        if (!hit) {
+            it = last - 1;
+            *it = line + 1;
+        }
+        std::rotate(first, it, it + 1);
+        return hit;
+    }
+
+    void save(CheckpointWriter &out) const {
+        out.write((uint64_t)m_lines.size());
+        for (uint64_t line : m_lines) {
+            out.write(line);
+        }
+    }
+
+    void restore(CheckpointReader &in) {
+        in.expect((uint64_t)m_lines.size(), "the shadow cache size");
+        for (uint64_t &line : m_lines) {
+            line = in.read<uint64_t>();
+        }
+    }
+
+    private:
+    size_t m_ways;
+    // Per set the line addresses plus one (zero is invalid), most recent first
+    std::vector<uint64_t> m_lines;
+};
+
+/*
+ * Runs a modulo-indexed LRU cache and a fully-associative LRU cache of the
+ * same geometry next to the real cache, so the conflict misses of the real
+ * cache can be compared with those of the plain cache it replaces.
+ */
+class ConflictMonitor {
+    public:
+    ConflictMonitor(size_t sets, size_t ways)
+    : m_baseline(sets, ways), m_full(sets * ways) {}
+
+    // Records an access of the real cache. Shadows are always updated,
+    // counters only when count is set.
+    void access(uint64_t line, bool hit, bool count) {
+        bool full_hit = m_full.access(line);
+        bool base_hit = m_baseline.access(line);
+        if (!count) {
+            return;
+        }
+        m_accesses++;
+        m_misses += !hit;
+        m_conflicts += !hit && full_hit;
+        m_base_misses += !base_hit;
+        m_base_conflicts += !base_hit && full_hit;
+    }
+
+    void print(const char *config, uint64_t victim_hits) const {
+        using namespace std;
+        int64_t removed = (int64_t)m_base_conflicts - (int64_t)m_conflicts;
+        cout << "Conflict misses (" << config << "):" << endl;
+        cout << "  Modulo indexing, no victim cache: " << m_base_misses
+             << " misses, " << m_base_conflicts << " conflict misses" << endl;
+        cout << "  This cache: " << m_misses << " misses, " << m_conflicts
+             << " conflict misses, " << victim_hits << " victim cache hits"
+             << endl;
+        cout << "  Conflict misses removed: " << removed;
+        if (m_base_conflicts) {
+            cout << " (" << 100.0 * removed / m_base_conflicts << "%)";
+        }
+        cout << " of " << m_accesses << " accesses" << endl;
+    }
+
+    void save(CheckpointWriter &out) const {
+        m_baseline.save(out);
+        m_full.save(out);
+        out.write(m_accesses);
+        out.write(m_misses);
+        out.write(m_conflicts);
+        out.write(m_base_misses);
+        out.write(m_base_conflicts);
+    }
+
+    void restore(CheckpointReader &in) {
+        m_baseline.restore(in);
+        m_full.restore(in);
+        m_accesses = in.read<uint64_t>();
+        m_misses = in.read<uint64_t>();
+        m_conflicts = in.read<uint64_t>();
+        m_base_misses = in.read<uint64_t>();
+        m_base_conflicts = in.read<uint64_t>();
+    }
+
+    private:
+    SetAssocLru m_baseline;
+    LruStack m_full;
+
+    uint64_t m_accesses = 0;
+    uint64_t m_misses = 0;
+    uint64_t m_conflicts = 0;
+    uint64_t m_base_misses = 0;
+    uint64_t m_base_conflicts = 0;
+};
+
+#endif
@@ -0,0 +1,217 @@
+/*
+ * File: cpu.h
+ *
+ * The CPU that executes the trace of one processor, one memory access at a
+ * time, with the fast-forward, sampling and checkpoint support of a run.
+ *
+ * Author(s): Michiel W. van Tol, Mike Lankamp, Jony Zhang,
+ *            Konstantinos Bousias, Simon Polstra
+ */
+
+#ifndef CPU_H
+#define CPU_H
+
+#include <functional>
+#include "memory.h"
+#include "sampling.h"
+#include "sync.h"
+
+PROFILED_MODULE(CPU), public Checkpointable {
+    public:
+    sc_in<bool> Port_CLK;
+    sc_in<Memory::RetCode> Port_MemDone;
+    sc_out<Memory::Function> Port_MemFunc;
+    sc_out<uint64_t> Port_MemAddr;
+    sc_inout_rv<sizeof(ADDRESS_UNIT) * 32> Port_MemData;
+
+    // Optional statistical sampling. Accesses outside of the detailed windows
+    // are sent through the functional interface instead of the ports.
+    Sampler *sampler = nullptr;
+    FunctionalIf *functional = nullptr;
+
+    // Number of accesses that are only warmed functionally before the
+    // detailed simulation starts.
+    uint64_t fast_forward = 0;
+
+    // When set, called once checkpoint_at accesses have been executed, after
+    // which the simulation stops.
+    std::function<void()> take_checkpoint;
+    uint64_t checkpoint_at = 0;
+
+    // Trace of the tracefile that this CPU executes
+    uint32_t cpuid = 0;
+
+    // A separate single-CPU tracefile to run instead, for multi-programmed
+    // workloads. cpuid then only selects the statistics counters.
+    TraceFile *program = nullptr;
+
+    // Trace entries executed and the time the trace ended, for the IPC
+    // proxy of the program
+    uint64_t entries = 0;
+    sc_time finish_time;
+
+    SyncStats sync;
+
+    SC_CTOR(CPU) {
+        SC_THREAD(execute);
+        sensitive << Port_CLK.pos();
+        dont_initialize();
+        s_running++;
+    }
+
+    const char *checkpoint_name() const override { return name(); }
+
+    // The access count goes along, so the fast-forward, the checkpoint and
+    // the sampling windows count from the start of the trace after a
+    // restore, and so does the open sampling window.
+    void save(CheckpointWriter &out) const override {
+        out.write(m_accesses);
+        out.write(m_window_hits);
+        out.write(entries);
+        sync.save(out);
+        out.write((uint8_t)(sampler != nullptr));
+        if (sampler) {
+            sampler->save(out);
+        }
+    }
+
+    void restore(CheckpointReader &in) override {
+        m_accesses = in.read<uint64_t>();
+        m_window_hits = in.read<uint64_t>();
+        entries = in.read<uint64_t>();
+        sync.restore(in);
+        in.expect((uint8_t)(sampler != nullptr), "the sampling configuration");
+        if (sampler) {
+            sampler->restore(in);
+        }
+    }
+
+    private:
+    // CPUs that did not finish their trace yet. The last one stops the
+    // simulation.
+    static inline unsigned s_running = 0;
+
+    uint64_t m_accesses = 0;    // memory accesses seen so far
+    uint64_t m_window_hits = 0; // hit count at the start of the window
+
+    void execute() {
+        TraceFile::Entry tr_data;
+        Memory::Function f;
+
+        TraceFile *trace = program ? program : tracefile_ptr;
+        uint32_t pid = program ? 0 : cpuid;
+
+        // Loop until end of tracefile
+        while (!trace->eof()) {
+            if (take_checkpoint && m_accesses == checkpoint_at) {
+                // The caches and memory are idle between two accesses.
+                take_checkpoint();
+                break;
+            }
+
+            // Get the next action for the processor in the trace
+            if (!trace->next(pid, tr_data)) {
+                cerr << "Error reading trace for CPU" << endl;
+                break;
+            }
+
+            sc_time entry_start = sc_time_stamp();
+            bool synchronizes = false;
+
+            switch (tr_data.type) {
+            case TraceFile::ENTRY_TYPE_READ:
+                f = Memory::FUNC_READ;
+                break;
+
+            case TraceFile::ENTRY_TYPE_WRITE:
+                f = Memory::FUNC_WRITE;
+                break;
+
+            case TraceFile::ENTRY_TYPE_ATOMIC:
+            case TraceFile::ENTRY_TYPE_LOCK:
+            case TraceFile::ENTRY_TYPE_UNLOCK:
+            case TraceFile::ENTRY_TYPE_BARRIER:
+                // Test-and-test-and-set: spin reading the word while waiting,
+                // then update it with an atomic read-modify-write.
+                f = tr_data.waiting ? Memory::FUNC_READ : Memory::FUNC_ATOMIC;
+                synchronizes = true;
+                break;
+
+            case TraceFile::ENTRY_TYPE_NOP: break;
+
+            default:
+                cerr << "Error, got invalid data from Trace" << endl;
+                exit(0);
+            }
+
+            Sampler::Phase phase = sampler ? sampler->phase(m_accesses) :
+                                             Sampler::PHASE_MEASURE;
+            if (m_accesses < fast_forward) {
+                phase = Sampler::PHASE_WARM;
+            }
+            if (phase == Sampler::PHASE_WARM) {
+                // Fast-forward without handshakes and without simulated time.
+                if (tr_data.type != TraceFile::ENTRY_TYPE_NOP) {
+                    functional->functional_access(f, tr_data.addr, false);
+                    m_accesses++;
+                }
+                continue;
+            }
+
+            if (tr_data.type != TraceFile::ENTRY_TYPE_NOP) {
+                stats_set_enabled(phase == Sampler::PHASE_MEASURE);
+                sc_time start = sc_time_stamp();
+
+                Port_MemAddr.write(tr_data.addr);
+                Port_MemFunc.write(f);
+
+                if (f != Memory::FUNC_READ) {
+                    // No data in trace, use address * 10 as data value.
+                    ADDRESS_UNIT data = tr_data.addr * 10;
+                    log(name(), "write value", data,
+                            "to address", tr_data.addr);
+                    Port_MemData.write(data);
+                    wait();
+                    // Now float the data wires with 64 "Z"'s
+                    Port_MemData.write(float_64_bit_wire);
+
+                } else {
+                    log(name(), "read on address", tr_data.addr);
+                }
+
+                wait(Port_MemDone.value_changed_event());
+
+                if (f != Memory::FUNC_WRITE) {
+                    log(name(), "read data", Port_MemData.read().to_uint(),
+                            "from address", tr_data.addr);
+                }
+
+                if (sampler && phase == Sampler::PHASE_MEASURE) {
+                    sampler->record((sc_time_stamp() - start) /
+                                    sc_time(CLOCK_PERIOD_NS, SC_NS));
+                    if (sampler->window_end(m_accesses)) {
+                        sampler->close_window(stats_hits(cpuid) - m_window_hits);
+                        m_window_hits = stats_hits(cpuid);
+                    }
+                }
+                m_accesses++;
+            } else {
+                log(name(), "executing NOP");
+            }
+            entries++;
+            // Advance one cycle in simulated time
+            wait();
+
+            if (synchronizes && stats_get_enabled())
+                sync.record(tr_data, (sc_time_stamp() - entry_start) / sc_time(CLOCK_PERIOD_NS, SC_NS));
+        }
+        finish_time = simulation_time();
+        sync.cycles = finish_time / sc_time(CLOCK_PERIOD_NS, SC_NS);
+
+        // Finished the Tracefile, now stop the simulation
+        if (--s_running == 0)
+            sc_stop();
+    }
+};
+
+#endif
@@ -0,0 +1,160 @@
+/*
+ * File: filter.cpp
+ *
+ * Filter mode: runs a trace through the caches without timing and writes what
+ * reaches the next level as a new tracefile.
+ */
+
+#include <iostream>
+#include "config.h"
+#include "tracewriter.h"
+
+// Sends a store past the cache, through the write-combining buffer if there
+// is one.
+static void filter_store(WriteCombiningBuffer& combining, uint64_t addr,
+                         vector<TraceFile::Entry>& out)
+{
+    WriteCombiningBuffer::Entry entry;
+    if (!combining.enabled())
+        out.push_back({TraceFile::ENTRY_TYPE_WRITE, addr});
+    else if (combining.store(addr, 0, CACHE_LINE_SIZE, entry))
+        out.push_back({TraceFile::ENTRY_TYPE_WRITE, entry.addr});
+}
+
+// A combined write of the line has to reach memory before the line is read.
+static void filter_take(WriteCombiningBuffer& combining, uint64_t addr,
+                        vector<TraceFile::Entry>& out)
+{
+    WriteCombiningBuffer::Entry entry;
+    if (combining.enabled() && combining.take(addr / CACHE_LINE_SIZE, entry))
+        out.push_back({TraceFile::ENTRY_TYPE_WRITE, entry.addr});
+}
+
+// Appends what one trace entry sends past the cache to out: the fill of a
+// miss, the stores that write-through or no-write-allocate pass on, gathered
+// by the write-combining buffer if there is one, and the synchronization
+// entries. Write-backs of the lines the access evicts are appended by the
+// functional_write_back of the cache.
+static void filter_entry(Cache& cache, const CacheConfig& config, WriteCombiningBuffer& combining,
+                         const TraceFile::Entry& e, vector<TraceFile::Entry>& out)
+{
+    bool hit;
+    switch (e.type) {
+    case TraceFile::ENTRY_TYPE_READ:
+        if (!cache.functional_access(Memory::FUNC_READ, e.addr, true)) {
+            filter_take(combining, e.addr, out);
+            out.push_back({TraceFile::ENTRY_TYPE_READ, e.addr});
+        }
+        break;
+    case TraceFile::ENTRY_TYPE_WRITE:
+        hit = cache.functional_access(Memory::FUNC_WRITE, e.addr, true);
+        if (!hit && config.write_allocate) {
+            filter_take(combining, e.addr, out);
+            out.push_back({TraceFile::ENTRY_TYPE_READ, e.addr});
+        }
+        if (config.write_through || (!hit && !config.write_allocate))
+            filter_store(combining, e.addr, out);
+        break;
+    case TraceFile::ENTRY_TYPE_ATOMIC:
+        hit = cache.functional_access(Memory::FUNC_ATOMIC, e.addr, true);
+        if (!hit || config.write_through) {
+            filter_take(combining, e.addr, out);
+            out.push_back(e);
+        }
+        break;
+    case TraceFile::ENTRY_TYPE_BARRIER:
+    case TraceFile::ENTRY_TYPE_LOCK:
+    case TraceFile::ENTRY_TYPE_UNLOCK:
+        out.push_back(e);
+        break;
+    default:
+        // Compute takes no memory traffic
+        break;
+    }
+}
+
+// Runs every CPU of the trace through a cache of its own, functionally,
+// and writes what reaches the next level as a new tracefile: a filter
+// stage for studies of the levels below, which can be chained. The CPUs
+// take turns, one input entry each, so atomics invalidate the lines of the
+// other caches in about the order the trace has them. The simulator reads
+// the trace of every CPU on its own, so the filtered traces are written as
+// they are; only the shorter ones are filled out with NOPs after their END,
+// which are never read.
+void run_filter(const Config& config)
+{
+    uint32_t cpus = tracefile_ptr->get_proc_count();
+    vector<vector<TraceFile::Entry>> out(cpus);
+    vector<unique_ptr<Cache>> caches;
+    vector<WriteCombiningBuffer> combining(
+        cpus, WriteCombiningBuffer(config.cache.write_combining, CACHE_LINE_SIZE));
+    for (uint32_t i = 0; i < cpus; ++i) {
+        caches.push_back(make_unique<Cache>(("cache" + to_string(i)).c_str(), config.cache));
+        caches.back()->cpuid = i;
+        caches.back()->functional_write_back = [&out, i](uint64_t addr) {
+            out[i].push_back({TraceFile::ENTRY_TYPE_WRITE, addr});
+        };
+    }
+    for (auto& cache : caches)
+        for (auto& peer : caches)
+            if (peer != cache)
+                cache->add_peer(*peer);
+
+    vector<bool> ended(cpus, false);
+    uint32_t running = cpus;
+    uint64_t read = 0;
+    while (running > 0) {
+        for (uint32_t i = 0; i < cpus; ++i) {
+            TraceFile::Entry e;
+            if (ended[i]) {
+                continue;
+            }
+            if (!tracefile_ptr->next_raw(i, e)) {
+                // The stores still in the write-combining buffer go out last
+                WriteCombiningBuffer::Entry entry;
+                while (combining[i].take_oldest(entry))
+                    out[i].push_back({TraceFile::ENTRY_TYPE_WRITE, entry.addr});
+                ended[i] = true;
+                running--;
+                out[i].push_back({TraceFile::ENTRY_TYPE_END, 0});
+                continue;
+            }
+            read++;
+            filter_entry(*caches[i], config.cache, combining[i], e, out[i]);
+        }
+    }
+
+    size_t rows = 0;
+    for (auto& o : out)
+        rows = max(rows, o.size());
+    TraceWriter writer(config.filter.c_str(), cpus);
+    uint64_t written[8] = {};
+    uint64_t filler = 0;
+    for (size_t row = 0; row < rows; ++row) {
+        for (auto& o : out) {
+            if (row < o.size()) {
+                writer.write(o[row].type, o[row].addr);
+                written[o[row].type]++;
+            } else {
+                writer.write(TraceFile::ENTRY_TYPE_NOP, 0);
+                filler++;
+            }
+        }
+    }
+    // Every CPU got its END entry already
+    writer.close_without_end();
+
+    uint64_t sync = written[TraceFile::ENTRY_TYPE_BARRIER] + written[TraceFile::ENTRY_TYPE_LOCK] +
+                    written[TraceFile::ENTRY_TYPE_UNLOCK];
+    uint64_t entries = written[TraceFile::ENTRY_TYPE_READ] + written[TraceFile::ENTRY_TYPE_WRITE] +
+                       written[TraceFile::ENTRY_TYPE_ATOMIC] + sync;
+    cout << "Filtered " << read << " entries of " << cpus << " CPUs into " << config.filter
+         << ": " << entries << " entries (" << setprecision(3)
+         << (read ? 100.0 * entries / read : 0.0) << "%)" << endl;
+    cout << "  " << written[TraceFile::ENTRY_TYPE_READ] << " reads, "
+         << written[TraceFile::ENTRY_TYPE_WRITE] << " writes and write-backs, "
+         << written[TraceFile::ENTRY_TYPE_ATOMIC] << " atomics, " << sync
+         << " synchronization" << endl;
+    if (filler)
+        cout << "  " << filler << " NOPs after the END of the shorter CPUs, never read" << endl;
+}
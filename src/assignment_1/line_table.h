@@ -0,0 +1,126 @@
+/*
+ * File: line_table.h
+ *
+ * Open-addressing hash table keyed by line address, for the shadow tag
+ * stores that run next to the cache on every access. Keys are kept in one
+ * flat array with linear probing, which avoids the node allocations of
+ * std::unordered_map; erase shifts the following entries back so no
+ * tombstones are left behind.
+ */
+
+#ifndef LINE_TABLE_H
+#define LINE_TABLE_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+template <typename V>
+class LineTable {
+    public:
+    explicit LineTable(size_t capacity = 16) {
+        size_t n = 16;
+        while (n < 2 * capacity) {
+            n *= 2;
+        }
+        m_slots.resize(n);
+    }
+
+    size_t size() const { return m_size; }
+
+    V *find(uint64_t line) {
+        for (size_t i = home(line);; i = (i + 1) & mask()) {
+            if (m_slots[i].key == 0) {
+                return nullptr;
+            }
+            if (m_slots[i].key == line + 1) {
+                return &m_slots[i].value;
+            }
+        }
+    }
+
+    // Value of the line, default-constructed and inserted if it is not
+    // present yet; inserted tells which of the two happened.
+    V &insert(uint64_t line, bool &inserted) {
+        if (2 * (m_size + 1) > m_slots.size()) {
+            grow();
+        }
+        size_t i = home(line);
+        for (; m_slots[i].key != 0; i = (i + 1) & mask()) {
+            if (m_slots[i].key == line + 1) {
+                inserted = false;
+                return m_slots[i].value;
+            }
+        }
+        m_slots[i].key = line + 1;
+        m_slots[i].value = V();
+        m_size++;
+        inserted = true;
+        return m_slots[i].value;
+    }
+
+    void erase(uint64_t line) {
+        size_t i = home(line);
+        for (; m_slots[i].key != line + 1; i = (i + 1) & mask()) {
+            if (m_slots[i].key == 0) {
+                return;
+            }
+        }
+        // Move later entries of the probe sequence into the hole
+        for (size_t j = (i + 1) & mask(); m_slots[j].key != 0; j = (j + 1) & mask()) {
+            size_t h = home(m_slots[j].key - 1);
+            if (((j - h) & mask()) >= ((j - i) & mask())) {
+                m_slots[i] = m_slots[j];
+                i = j;
+            }
+        }
+        m_slots[i].key = 0;
+        m_size--;
+    }
+
+    void clear() {
+        for (Slot &s : m_slots) {
+            s.key = 0;
+        }
+        m_size = 0;
+    }
+
+    // Calls f(line, value) for every entry, in no particular order.
+    template <typename F>
+    void for_each(F f) const {
+        for (const Slot &s : m_slots) {
+            if (s.key != 0) {
+                f(s.key - 1, s.value);
+            }
+        }
+    }
+
+    private:
+    struct Slot {
+        uint64_t key = 0; // line address plus one, zero is empty
+        V value {};
+    };
+
+    std::vector<Slot> m_slots;
+    size_t m_size = 0;
+
+    size_t mask() const { return m_slots.size() - 1; }
+
+    size_t home(uint64_t line) const {
+        return (line * 0x9E3779B97F4A7C15ULL >> 20) & mask();
+    }
+
+    void grow() {
+        std::vector<Slot> old(2 * m_slots.size());
+        std::swap(old, m_slots);
+        m_size = 0;
+        bool inserted;
+        for (const Slot &s : old) {
+            if (s.key != 0) {
+                insert(s.key - 1, inserted) = s.value;
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,122 @@
+/*
+ * File: memory.h
+ *
+ * Geometry of the simulated memory hierarchy, the main memory, and the
+ * functional interface through which its components are accessed without
+ * timing.
+ *
+ * Author(s): Michiel W. van Tol, Mike Lankamp, Jony Zhang,
+ *            Konstantinos Bousias, Simon Polstra
+ */
+
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <cmath>
+#include <systemc>
+#include "psa.h"
+#include "profile.h"
+
+using ADDRESS_UNIT = uint8_t;
+
+static constexpr size_t MEM_SIZE = 8912;
+static constexpr size_t CACHE_SETS = 128;
+static constexpr size_t CACHE_LINE_SIZE = 32;
+static constexpr size_t CACHE_WAYS = 8;
+
+static constexpr size_t CACHE_SIZE = CACHE_SETS * CACHE_WAYS * CACHE_LINE_SIZE;
+
+static constexpr double CLOCK_PERIOD_NS = 1.0;
+
+static constexpr size_t OFFSET_BITS = std::log2(CACHE_LINE_SIZE / sizeof(ADDRESS_UNIT)); // 5
+static constexpr size_t INDEX_BITS = std::log2(CACHE_SETS); // 7
+
+static_assert(CACHE_SIZE % (CACHE_LINE_SIZE * CACHE_WAYS) == 0,
+              "Cache size must be a multiple of cache line size * cache ways");
+
+
+PROFILED_MODULE(Memory), public Checkpointable {
+    public:
+    // FUNC_ATOMIC is a read-modify-write of a CPU, which writes the data
+    // and gets the old value back. Its cache gets the line exclusively and
+    // only sends reads and writes on to memory.
+    enum Function { FUNC_READ, FUNC_WRITE, FUNC_ATOMIC };
+
+    enum RetCode { RET_READ_DONE, RET_WRITE_DONE };
+
+    sc_in<bool> Port_CLK;
+    sc_in<Function> Port_Func;
+    sc_in<uint64_t> Port_Addr;
+    sc_out<RetCode> Port_Done;
+    sc_inout_rv<sizeof(ADDRESS_UNIT) * 32> Port_Data;
+
+    SC_CTOR(Memory) {
+        SC_THREAD(execute);
+        sensitive << Port_CLK.pos();
+        dont_initialize();
+
+        m_data = new ADDRESS_UNIT[MEM_SIZE];
+    }
+
+    ~Memory() {
+        delete[] m_data;
+    }
+
+    const char *checkpoint_name() const override { return name(); }
+
+    void save(CheckpointWriter &out) const override {
+        out.write(MEM_SIZE);
+        out.write_bytes(m_data, MEM_SIZE * sizeof(ADDRESS_UNIT));
+    }
+
+    void restore(CheckpointReader &in) override {
+        in.expect(MEM_SIZE, "the memory size");
+        in.read_bytes(m_data, MEM_SIZE * sizeof(ADDRESS_UNIT));
+    }
+
+    private:
+    ADDRESS_UNIT *m_data;
+
+    void execute() {
+        while (true) {
+            wait(Port_Func.value_changed_event());
+
+            Function f = Port_Func.read();
+            uint64_t addr = Port_Addr.read();
+            uint32_t data = 0;
+            if (f == FUNC_WRITE) {
+                data = Port_Data.read().to_uint();
+                log(name(), "received write on address", addr, "with data", data);
+            } else {
+                log(name(), "received read on address", addr);
+            }
+
+            // This simulates memory read/write delay
+            wait(100);
+
+            if (f == FUNC_READ) {
+                Port_Data.write((addr < MEM_SIZE) ? m_data[addr] : 0);
+                Port_Done.write(RET_READ_DONE);
+                wait();
+                Port_Data.write(float_64_bit_wire); // string with 64 "Z"'s
+            } else {
+                if (addr < MEM_SIZE) {
+                    m_data[addr] = data;
+                }
+                Port_Done.write(RET_WRITE_DONE);
+            }
+        }
+    }
+};
+
+// Untimed side door into a component of the memory hierarchy. Used to warm
+// its state without going through the signal handshakes, and by the
+// out-of-order CPU, which models the timing itself and sets count to have
+// the access counted in the statistics of the component. Returns whether
+// the access hit.
+struct FunctionalIf {
+    virtual ~FunctionalIf() {}
+    virtual bool functional_access(Memory::Function f, uint64_t addr, bool count) = 0;
+};
+
+#endif
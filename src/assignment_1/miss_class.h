@@ -0,0 +1,247 @@
+/*
+ * File: miss_class.h
+ *
+ * Classification of cache misses in the 3C model (Hill and Smith), plus
+ * coherence misses when several cores share memory:
+ *  - compulsory: the first access of the cache to the line
+ *  - coherence: another CPU wrote the line since this cache last accessed it
+ *  - capacity: a fully-associative LRU cache of the same capacity misses too
+ *  - conflict: only the set-associative placement made the access miss
+ * First touches are tracked in a hash set of all lines seen, the capacity
+ * test uses a fully-associative LRU shadow of the cache.
+ */
+
+#ifndef MISS_CLASS_H
+#define MISS_CLASS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "checkpoint.h"
+#include "conflict.h"
+#include "line_table.h"
+
+enum MissClass { MISS_COMPULSORY, MISS_COHERENCE, MISS_CAPACITY, MISS_CONFLICT,
+                 MISS_CLASSES };
+
+static inline const char *miss_class_name(MissClass c) {
+    static const char *names[] = {"Compulsory", "Coherence", "Capacity", "Conflict"};
+    return names[c];
+}
+
+/*
+ * Last write to every line by any CPU, shared by the classifiers of all
+ * caches. Accesses are numbered in the order the caches see them.
+ */
+class SharingTracker {
+    public:
+    uint64_t tick() { return ++m_clock; }
+
+    void write(uint64_t line, uint32_t cpu, uint64_t time) {
+        bool inserted;
+        m_writes.insert(line, inserted) = {time, cpu};
+    }
+
+    // Whether a CPU other than cpu wrote the line after time.
+    bool written_since(uint64_t line, uint32_t cpu, uint64_t time) {
+        Write *w = m_writes.find(line);
+        return w && w->cpu != cpu && w->time > time;
+    }
+
+    private:
+    struct Write {
+        uint64_t time;
+        uint32_t cpu;
+    };
+
+    LineTable<Write> m_writes;
+    uint64_t m_clock = 0;
+};
+
+class MissClassifier {
+    public:
+    // Shared with the classifiers of the other caches to find coherence
+    // misses, if set.
+    SharingTracker *sharing = nullptr;
+
+    MissClassifier(size_t sets, size_t ways)
+    : m_full(sets * ways), m_sets(sets), m_local_clock(0) {}
+
+    // Records an access of the real cache. The shadows are always updated,
+    // counters only when count is set.
+    void access(uint64_t line, size_t set, uint32_t cpu, bool write, bool hit, bool count) {
+        bool full_hit = m_full.access(line);
+        uint64_t now = sharing ? sharing->tick() : ++m_local_clock;
+        bool first;
+        uint64_t &last = m_seen.insert(line, first);
+        bool invalidated = !first && sharing && sharing->written_since(line, cpu, last);
+        last = now;
+        if (write && sharing) {
+            sharing->write(line, cpu, now);
+        }
+        if (!count) {
+            return;
+        }
+
+        SetCounts &s = m_sets[set];
+        s.accesses++;
+        if (hit) {
+            // An invalidation based protocol would have missed here
+            m_stale_hits += invalidated;
+            return;
+        }
+        MissClass c = first ? MISS_COMPULSORY :
+                      invalidated ? MISS_COHERENCE :
+                      full_hit ? MISS_CONFLICT : MISS_CAPACITY;
+        s.misses[c]++;
+    }
+
+    uint64_t misses(MissClass c) const {
+        uint64_t n = 0;
+        for (const SetCounts &s : m_sets) {
+            n += s.misses[c];
+        }
+        return n;
+    }
+
+    uint64_t stale_hits() const { return m_stale_hits; }
+
+    // One row per CPU, the share of each class in its misses.
+    static void print_cpus(const std::vector<std::pair<uint32_t, const MissClassifier *>> &cpus) {
+        using namespace std;
+        bool coherence = false;
+        for (auto &c : cpus) {
+            coherence = coherence || c.second->sharing;
+        }
+        cout << "Miss classification:" << endl;
+        cout << setw(10) << "CPU" << setw(10) << "Misses";
+        for (int c = 0; c < MISS_CLASSES; c++) {
+            if (c != MISS_COHERENCE || coherence) {
+                cout << setw(12) << miss_class_name((MissClass)c);
+            }
+        }
+        if (coherence) {
+            cout << setw(12) << "StaleHits";
+        }
+        cout << endl;
+        for (auto &c : cpus) {
+            const MissClassifier &m = *c.second;
+            uint64_t total = 0;
+            for (int k = 0; k < MISS_CLASSES; k++) {
+                total += m.misses((MissClass)k);
+            }
+            cout << setw(10) << c.first << setw(10) << total;
+            for (int k = 0; k < MISS_CLASSES; k++) {
+                if (k != MISS_COHERENCE || coherence) {
+                    cout << setw(12) << percentage(m.misses((MissClass)k), total);
+                }
+            }
+            if (coherence) {
+                cout << setw(12) << m.stale_hits();
+            }
+            cout << endl;
+        }
+    }
+
+    // The sets with the most misses, or all sets if n is zero.
+    void print_sets(const char *name, size_t n) const {
+        using namespace std;
+        vector<size_t> order(m_sets.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return m_sets[a].total() > m_sets[b].total();
+        });
+        if (n == 0 || n > order.size()) {
+            n = order.size();
+        }
+
+        cout << "Misses per set (" << name << ", " << n << " of " << m_sets.size()
+             << " sets with the most misses):" << endl;
+        cout << setw(10) << "Set" << setw(10) << "Accesses" << setw(10) << "Misses";
+        for (int c = 0; c < MISS_CLASSES; c++) {
+            if (c != MISS_COHERENCE || sharing) {
+                cout << setw(12) << miss_class_name((MissClass)c);
+            }
+        }
+        cout << endl;
+        for (size_t i = 0; i < n; i++) {
+            const SetCounts &s = m_sets[order[i]];
+            cout << setw(10) << order[i] << setw(10) << s.accesses << setw(10)
+                 << s.total();
+            for (int c = 0; c < MISS_CLASSES; c++) {
+                if (c != MISS_COHERENCE || sharing) {
+                    cout << setw(12) << s.misses[c];
+                }
+            }
+            cout << endl;
+        }
+    }
+
+    // The counters are saved along with the shadows, so a restored run
+    // reports the misses since the start of the trace like the others.
+    void save(CheckpointWriter &out) const {
+        m_full.save(out);
+        out.write(m_local_clock);
+        out.write((uint64_t)m_seen.size());
+        m_seen.for_each([&](uint64_t line, uint64_t time) {
+            out.write(line);
+            out.write(time);
+        });
+        out.write((uint64_t)m_sets.size());
+        for (const SetCounts &s : m_sets) {
+            out.write(s);
+        }
+        out.write(m_stale_hits);
+    }
+
+    void restore(CheckpointReader &in) {
+        m_full.restore(in);
+        m_local_clock = in.read<uint64_t>();
+        m_seen.clear();
+        bool inserted;
+        for (uint64_t n = in.read<uint64_t>(); n > 0; n--) {
+            uint64_t line = in.read<uint64_t>();
+            m_seen.insert(line, inserted) = in.read<uint64_t>();
+        }
+        in.expect((uint64_t)m_sets.size(), "the number of classified sets");
+        for (SetCounts &s : m_sets) {
+            s = in.read<SetCounts>();
+        }
+        m_stale_hits = in.read<uint64_t>();
+    }
+
+    private:
+    struct SetCounts {
+        uint64_t accesses = 0;
+        uint64_t misses[MISS_CLASSES] = {};
+
+        uint64_t total() const {
+            uint64_t n = 0;
+            for (uint64_t m : misses) {
+                n += m;
+            }
+            return n;
+        }
+    };
+
+    LruStack m_full;
+    LineTable<uint64_t> m_seen; // every line accessed, with its last access
+    std::vector<SetCounts> m_sets;
+    uint64_t m_local_clock;
+    uint64_t m_stale_hits = 0;
+
+    static std::string percentage(uint64_t n, uint64_t total) {
+        std::ostringstream s;
+        s << std::fixed << std::setprecision(2) << (total ? 100.0 * n / total : 0.0) << "%";
+        return s.str();
+    }
+};
+
+#endif
@@ -0,0 +1,154 @@
+/*
+ * File: mmu.cpp
+ *
+ * Implementation of the address translation stage, see mmu.h.
+ */
+
+#include "mmu.h"
+
+Mmu::Mmu(sc_module_name name, const TlbConfig &config)
+: ProfiledModule(name), m_config(config),
+  m_l1(config.l1_entries, config.l1_ways),
+  m_l2(config.l2_entries, config.l2_ways),
+  m_page_table(config.page_size) {
+    SC_THREAD(execute);
+    sensitive << Port_CLK.pos();
+    dont_initialize();
+}
+
+bool Mmu::functional_access(Memory::Function f, uint64_t addr, bool count)
+{
+    uint64_t vpn = addr >> m_page_table.page_bits();
+    uint64_t pfn;
+    if (!m_l1.lookup(vpn, pfn)) {
+        if (!m_l2.lookup(vpn, pfn)) {
+            for (unsigned level = 0; level < m_page_table.levels(); ++level)
+                lower->functional_access(Memory::FUNC_READ, m_page_table.pte_address(level, addr), count);
+            pfn = m_page_table.frame(vpn);
+            m_l2.insert(vpn, pfn);
+        }
+        m_l1.insert(vpn, pfn);
+    }
+    return lower->functional_access(f, physical(pfn, addr), count);
+}
+
+void Mmu::save(CheckpointWriter &out) const {
+    out.write(m_config.page_size);
+    m_l1.save(out);
+    m_l2.save(out);
+    m_page_table.save(out);
+    out.write(m_l1_hits);
+    out.write(m_l2_hits);
+    out.write(m_walks);
+    out.write(m_walk_cycles);
+}
+
+void Mmu::restore(CheckpointReader &in) {
+    in.expect(m_config.page_size, "the page size");
+    m_l1.restore(in);
+    m_l2.restore(in);
+    m_page_table.restore(in);
+    m_l1_hits = in.read<uint64_t>();
+    m_l2_hits = in.read<uint64_t>();
+    m_walks = in.read<uint64_t>();
+    m_walk_cycles = in.read<uint64_t>();
+}
+
+void Mmu::print_stats() const {
+    uint64_t accesses = m_l1_hits + m_l2_hits + m_walks;
+    uint64_t l2_accesses = m_l2_hits + m_walks;
+    cout << "Translation (" << m_config.page_size << " byte pages, "
+         << m_page_table.levels() << " level page table):" << endl;
+    cout << "  L1 TLB hit rate: " << setprecision(4)
+         << (accesses ? 100.0 * m_l1_hits / accesses : 0.0) << "% ("
+         << m_l1_hits << "/" << accesses << ")" << endl;
+    cout << "  L2 TLB hit rate: "
+         << (l2_accesses ? 100.0 * m_l2_hits / l2_accesses : 0.0) << "% ("
+         << m_l2_hits << "/" << l2_accesses << ")" << endl;
+    cout << "  Page walks: " << m_walks << ", average latency "
+         << (m_walks ? (double)m_walk_cycles / m_walks : 0.0) << " cycles, "
+         << m_walk_cycles << " cycles in total" << endl;
+    cout << "  Page table pages: " << m_page_table.tables() << endl;
+}
+
+uint64_t Mmu::physical(uint64_t pfn, uint64_t vaddr) const
+{
+    unsigned bits = m_page_table.page_bits();
+    return (pfn << bits) | (vaddr & ((1ULL << bits) - 1));
+}
+
+void Mmu::read_pte(uint64_t addr)
+{
+    log(name(), "page walk read address =", addr);
+    Port_MemAddr.write(addr);
+    Port_MemFunc.write(Memory::FUNC_READ);
+    wait(Port_MemDone.value_changed_event());
+    wait();
+}
+
+uint64_t Mmu::translate(uint64_t addr)
+{
+    uint64_t vpn = addr >> m_page_table.page_bits();
+    uint64_t pfn;
+    bool count = stats_get_enabled();
+
+    if (m_l1.lookup(vpn, pfn)) {
+        if (count)
+            m_l1_hits++;
+        return physical(pfn, addr);
+    }
+
+    if (m_l2.lookup(vpn, pfn)) {
+        if (count)
+            m_l2_hits++;
+        wait(m_config.l2_latency);
+    } else {
+        log(name(), "TLB miss address =", addr);
+        sc_time start = sc_time_stamp();
+        for (unsigned level = 0; level < m_page_table.levels(); ++level)
+            read_pte(m_page_table.pte_address(level, addr));
+        pfn = m_page_table.frame(vpn);
+        m_l2.insert(vpn, pfn);
+        if (count) {
+            m_walks++;
+            m_walk_cycles += (sc_time_stamp() - start) / sc_time(CLOCK_PERIOD_NS, SC_NS);
+        }
+    }
+    m_l1.insert(vpn, pfn);
+    return physical(pfn, addr);
+}
+
+void Mmu::execute()
+{
+    while (true) {
+        wait(Port_Func.value_changed_event());
+
+        Memory::Function f = Port_Func.read();
+        uint64_t addr = Port_Addr.read();
+        uint32_t data = 0;
+        if (f != Memory::FUNC_READ)
+            data = Port_Data.read().to_uint();
+
+        uint64_t paddr = translate(addr);
+
+        // Forward the request with the physical address
+        Port_MemAddr.write(paddr);
+        Port_MemFunc.write(f);
+        if (f != Memory::FUNC_READ) {
+            Port_MemData.write(data);
+            wait();
+            Port_MemData.write(float_64_bit_wire);
+        }
+
+        wait(Port_MemDone.value_changed_event());
+
+        if (f != Memory::FUNC_WRITE) {
+            Port_Data.write(Port_MemData.read().to_uint());
+            Port_Done.write(Memory::RET_READ_DONE);
+            wait();
+            Port_Data.write(float_64_bit_wire);
+        } else {
+            Port_Done.write(Memory::RET_WRITE_DONE);
+        }
+    }
+}
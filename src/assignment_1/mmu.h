@@ -0,0 +1,73 @@
+/*
+ * File: mmu.h
+ *
+ * Address translation stage between the CPU and the cache: an L1 and an L2 TLB
+ * and the page walks behind them.
+ */
+
+#ifndef MMU_H
+#define MMU_H
+
+#include "memory.h"
+#include "tlb.h"
+
+/*
+ * Optional address translation between the CPU and the cache. Looks up the
+ * virtual page in the L1 TLB (no extra latency) and the L2 TLB, and on a miss
+ * walks the page table with one read per level through the cache. The
+ * request is then forwarded to the cache with the physical address.
+ */
+PROFILED_MODULE(Mmu), public FunctionalIf, public Checkpointable {
+    public:
+    sc_in<bool> Port_CLK;
+
+    sc_in<Memory::Function> Port_Func;
+    sc_out<Memory::RetCode> Port_Done;
+    sc_in<uint64_t> Port_Addr;
+    sc_inout_rv<sizeof(ADDRESS_UNIT) * 32> Port_Data;
+
+    sc_out<Memory::Function> Port_MemFunc;
+    sc_in<Memory::RetCode> Port_MemDone;
+    sc_out<uint64_t> Port_MemAddr;
+    sc_inout_rv<sizeof(ADDRESS_UNIT) * 32> Port_MemData;
+
+    // Untimed path of the cache, used for functional warming
+    FunctionalIf *lower = nullptr;
+
+    SC_HAS_PROCESS(Mmu);
+
+    Mmu(sc_module_name name, const TlbConfig &config);
+
+    bool functional_access(Memory::Function f, uint64_t addr, bool count) override;
+
+    const char *checkpoint_name() const override { return name(); }
+
+    void save(CheckpointWriter &out) const override;
+
+    void restore(CheckpointReader &in) override;
+
+    void print_stats() const;
+
+    private:
+    TlbConfig m_config;
+    Tlb m_l1;
+    Tlb m_l2;
+    PageTable m_page_table;
+
+    uint64_t m_l1_hits = 0;
+    uint64_t m_l2_hits = 0;
+    uint64_t m_walks = 0;
+    uint64_t m_walk_cycles = 0;
+
+    uint64_t physical(uint64_t pfn, uint64_t vaddr) const;
+
+    // Reads a page table entry through the cache. The cache needs a cycle
+    // after its response before it accepts the next request.
+    void read_pte(uint64_t addr);
+
+    uint64_t translate(uint64_t addr);
+
+    void execute();
+};
+
+#endif
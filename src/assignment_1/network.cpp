@@ -0,0 +1,224 @@
+/*
+ * File: network.cpp
+ *
+ * Multi-core mode: the cores, their network interfaces and the run over the
+ * mesh, see network.h.
+ */
+
+#include <iomanip>
+#include <iostream>
+#include "config.h"
+#include "cpu.h"
+
+// Memory side of a core's cache in the multi-core mode: forwards the requests
+// of the cache into the network and completes them when the response arrives.
+PROFILED_MODULE(NocInterface) {
+    public:
+    sc_in<bool> Port_CLK;
+    sc_in<Memory::Function> Port_Func;
+    sc_in<uint64_t> Port_Addr;
+    sc_out<Memory::RetCode> Port_Done;
+    sc_inout_rv<sizeof(ADDRESS_UNIT) * 32> Port_Data;
+
+    Network* network = nullptr;
+    unsigned core = 0;
+
+    SC_CTOR(NocInterface) {
+        SC_THREAD(execute);
+        sensitive << Port_CLK.pos();
+        dont_initialize();
+    }
+
+    private:
+    void execute() {
+        while (true) {
+            wait(Port_Func.value_changed_event());
+
+            Memory::Function f = Port_Func.read();
+            uint64_t addr = Port_Addr.read();
+            uint32_t data = f == Memory::FUNC_WRITE ? Port_Data.read().to_uint() : 0;
+            log(name(), "send request for address", addr);
+            network->request(core, f, addr, data);
+
+            while (!network->response(core, data))
+                wait();
+
+            if (f == Memory::FUNC_READ) {
+                Port_Data.write(data);
+                Port_Done.write(Memory::RET_READ_DONE);
+                wait();
+                Port_Data.write(float_64_bit_wire); // string with 64 "Z"'s
+            } else {
+                Port_Done.write(Memory::RET_WRITE_DONE);
+            }
+        }
+    }
+};
+
+// One core of the multi-core mode: a CPU, its private cache and the network
+// interface of the cache, with the signals between them.
+struct Core {
+    CPU cpu;
+    Cache cache;
+    NocInterface ni;
+
+    ProfiledBuffer<Memory::Function> sigFunc;
+    ProfiledBuffer<Memory::RetCode> sigDone;
+    ProfiledSignal<uint64_t> sigAddr;
+    ProfiledSignalRv<sizeof(ADDRESS_UNIT) * 32> sigData;
+
+    ProfiledBuffer<Memory::Function> sigMemFunc;
+    ProfiledBuffer<Memory::RetCode> sigMemDone;
+    ProfiledSignal<uint64_t> sigMemAddr;
+    ProfiledSignalRv<sizeof(ADDRESS_UNIT) * 32> sigMemData;
+
+    Core(unsigned id, const CacheConfig& config, Network& network, sc_clock& clk)
+    : cpu(("cpu" + to_string(id)).c_str()),
+      cache(("cache" + to_string(id)).c_str(), config),
+      ni(("ni" + to_string(id)).c_str()) {
+        cpu.cpuid = cache.cpuid = ni.core = id;
+        cpu.functional = &cache;
+        ni.network = &network;
+
+        cpu.Port_MemFunc(sigFunc);
+        cpu.Port_MemAddr(sigAddr);
+        cpu.Port_MemData(sigData);
+        cpu.Port_MemDone(sigDone);
+
+        cache.Port_Func(sigFunc);
+        cache.Port_Addr(sigAddr);
+        cache.Port_Data(sigData);
+        cache.Port_Done(sigDone);
+
+        cache.Port_MemFunc(sigMemFunc);
+        cache.Port_MemAddr(sigMemAddr);
+        cache.Port_MemData(sigMemData);
+        cache.Port_MemDone(sigMemDone);
+
+        ni.Port_Func(sigMemFunc);
+        ni.Port_Addr(sigMemAddr);
+        ni.Port_Data(sigMemData);
+        ni.Port_Done(sigMemDone);
+
+        cpu.Port_CLK(clk);
+        cache.Port_CLK(clk);
+        ni.Port_CLK(clk);
+    }
+};
+
+// Opens the tracefiles of the extra programs. Every program, the main
+// tracefile included, needs to be a single-CPU trace; num_cpus becomes the
+// number of programs.
+vector<unique_ptr<TraceFile>> open_programs(const Config& config)
+{
+    vector<unique_ptr<TraceFile>> programs;
+    if (config.programs.empty())
+        return programs;
+    if (tracefile_ptr->get_proc_count() != 1)
+        throw runtime_error("Error, --program needs a single-CPU main tracefile");
+    for (const string& name : config.programs) {
+        programs.push_back(make_unique<TraceFile>(name.c_str()));
+        if (programs.back()->get_proc_count() != 1)
+            throw runtime_error("Error, " + name + " is not a single-CPU tracefile");
+    }
+    num_cpus = programs.size() + 1;
+    if (!config.alone_ipc.empty() && config.alone_ipc.size() != num_cpus)
+        throw runtime_error("Error, --alone-ipc needs the IPC of every program");
+    return programs;
+}
+
+// Per core the trace entries executed per cycle until its trace ended (the
+// IPC proxy), the L1 and LLC hit rates, and with the IPC of every program
+// alone the weighted speedup and fairness of the shared run.
+static void print_programs(const vector<unique_ptr<Core>>& cores, const Network& network,
+                           const Config& config)
+{
+    bool alone = !config.alone_ipc.empty() && config.alone_ipc.size() == cores.size();
+
+    cout << "Programs:" << endl;
+    cout << setw(10) << "CPU" << setw(10) << "Entries" << setw(10) << "Cycles"
+         << setw(10) << "IPC" << setw(10) << "L1Hit" << setw(10) << "LLCHit";
+    if (alone)
+        cout << setw(10) << "Speedup";
+    cout << "  Trace" << endl;
+
+    double weighted = 0.0, harmonic = 0.0;
+    double min_speedup = 0.0, max_speedup = 0.0;
+    for (size_t i = 0; i < cores.size(); ++i) {
+        const CPU& cpu = cores[i]->cpu;
+        double cycles = cpu.finish_time / sc_time(CLOCK_PERIOD_NS, SC_NS);
+        double ipc = cycles > 0 ? cpu.entries / cycles : 0.0;
+        uint64_t accesses = stats_accesses(cpu.cpuid);
+        uint64_t llc = network.llc_accesses(cpu.cpuid);
+        cout << setw(10) << cpu.cpuid << setw(10) << cpu.entries << setw(10)
+             << (uint64_t)cycles << setw(10) << setprecision(4) << ipc
+             << setw(10) << (accesses ? 100.0 * stats_hits(cpu.cpuid) / accesses : 0.0)
+             << setw(10) << (llc ? 100.0 * network.llc_hits(cpu.cpuid) / llc : 0.0);
+        if (alone) {
+            double speedup = ipc / config.alone_ipc[i];
+            weighted += speedup;
+            harmonic += 1.0 / speedup;
+            min_speedup = i == 0 ? speedup : min(min_speedup, speedup);
+            max_speedup = i == 0 ? speedup : max(max_speedup, speedup);
+            cout << setw(10) << speedup;
+        }
+        if (config.programs.empty())
+            cout << "  CPU " << i << " of the tracefile" << endl;
+        else
+            cout << "  " << (i == 0 ? string("main tracefile") : config.programs[i - 1]) << endl;
+    }
+    if (alone) {
+        cout << "Weighted speedup: " << weighted << ", harmonic mean speedup: "
+             << cores.size() / harmonic << ", fairness (min/max speedup): "
+             << min_speedup / max_speedup << endl;
+    }
+}
+
+// Runs every CPU of the trace, or every program, on its own core, connected
+// over the mesh network to the banked LLC. The private caches are only kept
+// coherent for atomic accesses, which invalidate the copies of the others.
+void run_noc(const Config& config, const vector<unique_ptr<TraceFile>>& programs)
+{
+    sc_clock clk("clk", sc_time(CLOCK_PERIOD_NS, SC_NS));
+    Network network("network", config.mesh, config.llc, num_cpus);
+    network.Port_CLK(clk);
+
+    SharingTracker sharing;
+    vector<unique_ptr<Core>> cores;
+    for (unsigned i = 0; i < num_cpus; ++i) {
+        cores.push_back(make_unique<Core>(i, config.cache, network, clk));
+        // Independent programs do not share data
+        if (programs.empty())
+            cores.back()->cache.share(sharing);
+        else if (i > 0)
+            cores.back()->cpu.program = programs[i - 1].get();
+    }
+    if (programs.empty()) {
+        for (auto& core : cores)
+            for (auto& peer : cores)
+                if (peer != core)
+                    core->cache.add_peer(peer->cache);
+    }
+
+    cout << "Running (press CTRL+C to interrupt)... " << endl;
+    if (config.profile)
+        KernelProfile::enable();
+    sc_start();
+
+    stats_print();
+    KernelProfile::print();
+    vector<pair<uint32_t, const MissClassifier*>> misses;
+    for (auto& core : cores)
+        misses.emplace_back(core->cache.cpuid, &core->cache.misses());
+    MissClassifier::print_cpus(misses);
+    vector<pair<uint32_t, const SyncStats*>> sync;
+    for (auto& core : cores)
+        sync.emplace_back(core->cpu.cpuid, &core->cpu.sync);
+    SyncStats::print_cpus(sync);
+    for (auto& core : cores) {
+        core->cache.flush_write_combining();
+        core->cache.print_stats();
+    }
+    network.print_stats();
+    print_programs(cores, network, config);
+}
@@ -0,0 +1,209 @@
+/*
+ * File: network.h
+ *
+ * Memory system of the multi-core mode: the 2D mesh of noc.h between the
+ * private caches of the cores and the banks of a shared last-level cache.
+ */
+
+#ifndef NETWORK_H
+#define NETWORK_H
+
+#include <deque>
+#include "memory.h"
+#include "noc.h"
+#include "partition.h"
+
+struct LlcConfig {
+    size_t banks = 4;
+    size_t sets = 256;           // per bank
+    size_t ways = 8;
+    unsigned latency = 10;       // cycles for a hit
+    unsigned memory_latency = 100;
+
+    // Way-partitioning between the cores, and for static partitioning the
+    // ways of every core
+    PartitionPolicy partition = PARTITION_NONE;
+    vector<size_t> partition_ways;
+    uint64_t ucp_interval = 1000; // LLC accesses between repartitionings
+
+    // The cores run independent programs, whose addresses never refer to
+    // the same lines
+    bool separate_address_spaces = false;
+};
+
+/*
+ * Multi-core memory system: the private caches of the cores send their misses
+ * and write-backs over a 2D mesh network to a shared, banked last-level
+ * cache. Core i sits at node i and the banks are spread evenly over the
+ * nodes; lines are interleaved over the banks. A bank serves one request at
+ * a time, taking the LLC latency on a hit and the memory latency on a miss.
+ * The LLC keeps tags only, its ways can be partitioned between the cores;
+ * the data lives in one backing store.
+ */
+PROFILED_MODULE(Network) {
+    public:
+    enum PacketKind { READ_REQUEST, WRITE_REQUEST, READ_RESPONSE, WRITE_ACK };
+
+    // Header of every packet; requests and responses that carry a line add
+    // CACHE_LINE_SIZE bytes.
+    static constexpr unsigned HEADER_BYTES = 8;
+
+    sc_in<bool> Port_CLK;
+
+    SC_HAS_PROCESS(Network);
+
+    Network(sc_module_name name, const NocConfig& noc, const LlcConfig& llc, size_t cores)
+    : ProfiledModule(name), m_mesh(noc), m_llc(llc),
+      m_partitioner(llc.partition, cores, llc.banks * llc.sets, llc.ways,
+                    llc.partition_ways, llc.ucp_interval),
+      m_responses(cores) {
+        SC_THREAD(execute);
+        sensitive << Port_CLK.pos();
+        dont_initialize();
+
+        if (cores > m_mesh.nodes())
+            throw runtime_error("Error, the mesh has fewer nodes than the trace has CPUs");
+        if (llc.banks == 0 || llc.banks > m_mesh.nodes())
+            throw runtime_error("Error, the number of LLC banks must be between 1 and the number of mesh nodes");
+        m_banks.reserve(llc.banks);
+        for (size_t b = 0; b < llc.banks; ++b)
+            m_banks.emplace_back(llc.sets, llc.ways, m_partitioner, b * m_mesh.nodes() / llc.banks);
+        m_data = new ADDRESS_UNIT[MEM_SIZE]();
+    }
+
+    ~Network() {
+        delete[] m_data;
+    }
+
+    // Sends a request of a core to the bank of the address.
+    void request(unsigned core, Memory::Function f, uint64_t addr, uint32_t data)
+    {
+        Packet p;
+        p.src = core;
+        p.dst = m_banks[bank_of(addr)].node;
+        p.kind = f == Memory::FUNC_READ ? READ_REQUEST : WRITE_REQUEST;
+        p.flits = m_mesh.flits_for(HEADER_BYTES + (f == Memory::FUNC_WRITE ? CACHE_LINE_SIZE : 0));
+        p.addr = addr;
+        p.data = data;
+        m_mesh.inject(p);
+    }
+
+    // Takes the response to the outstanding request of a core, if it arrived.
+    bool response(unsigned core, uint32_t& data)
+    {
+        if (m_responses[core].empty())
+            return false;
+        data = m_responses[core].front().data;
+        m_responses[core].pop_front();
+        return true;
+    }
+
+    void print_stats() const
+    {
+        m_mesh.print_stats(cout);
+        cout << "LLC (" << m_llc.banks << " banks of " << m_llc.sets << " sets x "
+             << m_llc.ways << " ways):" << endl;
+        for (size_t b = 0; b < m_banks.size(); ++b) {
+            const Bank& bank = m_banks[b];
+            cout << "  Bank " << b << " at node " << bank.node << ": "
+                 << bank.accesses << " accesses, hit rate "
+                 << (bank.accesses ? 100.0 * bank.hits / bank.accesses : 0.0)
+                 << "%" << endl;
+        }
+        m_partitioner.print();
+    }
+
+    // Hits and accesses of a core in the LLC
+    uint64_t llc_accesses(unsigned core) const { return m_partitioner.accesses(core); }
+    uint64_t llc_hits(unsigned core) const { return m_partitioner.hits(core); }
+
+    private:
+    struct Bank {
+        PartitionedTags tags;
+        unsigned node;
+        uint64_t busy_until = 0;
+        deque<pair<uint64_t, Packet>> done; // responses and the cycle they are ready
+        uint64_t accesses = 0;
+        uint64_t hits = 0;
+
+        Bank(size_t sets, size_t ways, WayPartitioner& partitioner, unsigned node)
+        : tags(sets, ways, partitioner), node(node) {}
+    };
+
+    // Bits of the line address that keep separate address spaces apart
+    static constexpr unsigned ADDRESS_SPACE_SHIFT = 48;
+
+    Mesh m_mesh;
+    LlcConfig m_llc;
+    WayPartitioner m_partitioner;
+    vector<Bank> m_banks;
+    vector<deque<Packet>> m_responses;
+    ADDRESS_UNIT* m_data;
+
+    size_t bank_of(uint64_t addr) const { return (addr >> OFFSET_BITS) % m_banks.size(); }
+
+    // Looks up the request in its bank and queues the response behind the
+    // requests the bank is still serving.
+    void serve(Bank& bank, const Packet& req)
+    {
+        uint64_t line = req.addr >> OFFSET_BITS;
+        if (m_llc.separate_address_spaces)
+            line |= (uint64_t)req.src << ADDRESS_SPACE_SHIFT;
+        bool hit = bank.tags.access(line / m_banks.size(), req.src);
+        m_partitioner.access(line, req.src, hit, stats_get_enabled());
+        if (stats_get_enabled()) {
+            bank.accesses++;
+            bank.hits += hit;
+        }
+        uint64_t start = max(bank.busy_until, m_mesh.cycle());
+        bank.busy_until = start + (hit ? m_llc.latency : m_llc.latency + m_llc.memory_latency);
+
+        Packet resp;
+        resp.src = bank.node;
+        resp.dst = req.src;
+        resp.addr = req.addr;
+        if (req.kind == READ_REQUEST) {
+            resp.kind = READ_RESPONSE;
+            resp.data = req.addr < MEM_SIZE ? m_data[req.addr] : 0;
+            resp.flits = m_mesh.flits_for(HEADER_BYTES + CACHE_LINE_SIZE);
+        } else {
+            if (req.addr < MEM_SIZE)
+                m_data[req.addr] = req.data;
+            resp.kind = WRITE_ACK;
+            resp.flits = m_mesh.flits_for(HEADER_BYTES);
+        }
+        bank.done.emplace_back(bank.busy_until, resp);
+    }
+
+    void execute()
+    {
+        while (true) {
+            wait();
+            for (Bank& bank : m_banks) {
+                while (!bank.done.empty() && bank.done.front().first <= m_mesh.cycle()) {
+                    m_mesh.inject(bank.done.front().second);
+                    bank.done.pop_front();
+                }
+            }
+            m_mesh.step();
+
+            Packet p;
+            for (unsigned node = 0; node < m_mesh.nodes(); ++node) {
+                while (m_mesh.eject(node, p)) {
+                    if (p.kind == READ_RESPONSE || p.kind == WRITE_ACK) {
+                        m_responses[p.dst].push_back(p);
+                        continue;
+                    }
+                    for (Bank& bank : m_banks) {
+                        if (bank.node == node) {
+                            serve(bank, p);
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+    }
+};
+
+#endif
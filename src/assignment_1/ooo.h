@@ -0,0 +1,278 @@
+/*
+ * File: ooo.h
+ *
+ * Timing model of an out-of-order core that keeps several memory accesses in
+ * flight. Trace entries enter a reorder window in order, up to the issue
+ * width per cycle. Loads and stores also take a load/store queue entry and
+ * issue as soon as possible, oldest first, while earlier misses are still
+ * outstanding; NOP entries are compute operations of one cycle. Entries
+ * retire in order once complete. A store retires when it has issued but
+ * keeps its queue entry until its write completes.
+ *
+ * The trace has no register dependencies, so all accesses are treated as
+ * independent, except that a load waits for every older store to the same
+ * address to issue, after which the store forwards its data. The cache
+ * contents are kept by the access callback; the model adds the hit or miss
+ * latency. A miss takes an MSHR until it completes and later accesses to the
+ * same line wait for it. When all MSHRs are taken no access issues, since
+ * it is not known beforehand whether it would miss.
+ */
+
+#ifndef OOO_H
+#define OOO_H
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+struct OooConfig {
+    bool enabled = false;
+    unsigned width = 4;         // entries dispatched, issued and retired per cycle
+    size_t rob = 64;            // reorder window entries
+    size_t lsq = 16;            // loads and stores in flight
+    size_t mshrs = 8;           // outstanding misses
+    unsigned hit_latency = 2;   // cycles
+    unsigned miss_latency = 102;
+};
+
+class OooCore {
+    public:
+    enum Kind { COMPUTE, LOAD, STORE };
+
+    // Performs the access in the memory hierarchy, returns whether it hit
+    using Access = std::function<bool(bool store, uint64_t addr)>;
+
+    OooCore(const OooConfig &config, unsigned line_bits, Access access)
+    : m_config(config), m_line_bits(line_bits), m_access(access) {}
+
+    uint64_t cycles() const { return m_cycle; }
+    bool empty() const { return m_rob.empty() && m_draining.empty(); }
+
+    // Adds the next trace entry to the window. Returns false, and records
+    // why, when the reorder window or the load/store queue is full.
+    bool dispatch(Kind kind, uint64_t addr) {
+        if (m_rob.size() >= m_config.rob) {
+            m_blocked = DISPATCH_ROB;
+            return false;
+        }
+        if (kind != COMPUTE && lsq_used() >= m_config.lsq) {
+            m_blocked = DISPATCH_LSQ;
+            return false;
+        }
+        Op op;
+        op.kind = kind;
+        op.addr = addr;
+        if (kind == COMPUTE) {
+            op.issued = true;
+            op.done = m_cycle + 1;
+        } else {
+            m_lsq++;
+        }
+        m_rob.push_back(op);
+        return true;
+    }
+
+    // Issues, completes and retires the entries of one cycle.
+    void cycle() {
+        if (m_blocked != DISPATCH_OK) {
+            m_dispatch_stalls[m_blocked]++;
+        }
+        m_blocked = DISPATCH_OK;
+
+        for (auto it = m_outstanding.begin(); it != m_outstanding.end();) {
+            it = it->second <= m_cycle ? m_outstanding.erase(it) : std::next(it);
+        }
+        m_draining.erase(std::remove_if(m_draining.begin(), m_draining.end(),
+                                        [&](const Op &s) { return s.mem_done <= m_cycle; }),
+                         m_draining.end());
+
+        Stall head_blocked = issue();
+
+        if (!m_outstanding.empty()) {
+            m_mlp_sum += m_outstanding.size();
+            m_mlp_cycles++;
+        }
+
+        unsigned retired = 0;
+        while (retired < m_config.width && !m_rob.empty() && m_rob.front().issued &&
+               m_rob.front().done <= m_cycle) {
+            retire(m_rob.front());
+            m_rob.pop_front();
+            retired++;
+        }
+        if (retired == 0) {
+            m_stalls[stall_cause(head_blocked)]++;
+        }
+        m_cycle++;
+    }
+
+    void print(std::ostream &out) const {
+        using namespace std;
+        out << "Out-of-order core (width " << m_config.width << ", ROB "
+            << m_config.rob << ", LSQ " << m_config.lsq << ", " << m_config.mshrs
+            << " MSHRs, hit latency " << m_config.hit_latency << ", miss latency "
+            << m_config.miss_latency << "):" << endl;
+        uint64_t retired = m_retired[COMPUTE] + m_retired[LOAD] + m_retired[STORE];
+        out << "  Retired " << retired << " entries in " << m_cycle << " cycles, IPC "
+            << setprecision(4) << (m_cycle ? (double)retired / m_cycle : 0.0) << endl;
+        out << "  " << m_retired[LOAD] << " loads, " << m_retired[STORE] << " stores, "
+            << m_retired[COMPUTE] << " compute; " << m_misses << " misses, "
+            << m_merged << " accesses waited for an outstanding miss, "
+            << m_forwarded << " loads forwarded from stores" << endl;
+        out << "  MLP: " << (m_mlp_cycles ? (double)m_mlp_sum / m_mlp_cycles : 0.0)
+            << " outstanding misses on average over the " << m_mlp_cycles
+            << " cycles with a miss outstanding" << endl;
+
+        static const char *stall_names[] = {"miss", "hit latency", "compute",
+                                            "store-load order", "MSHRs full",
+                                            "issue width", "window empty"};
+        out << "  Cycles without retirement:";
+        for (int s = 0; s < STALLS; s++) {
+            out << " " << stall_names[s] << " " << m_stalls[s];
+        }
+        out << endl;
+        out << "  Dispatch stall cycles: ROB full " << m_dispatch_stalls[DISPATCH_ROB]
+            << ", LSQ full " << m_dispatch_stalls[DISPATCH_LSQ] << endl;
+    }
+
+    private:
+    enum Dispatch { DISPATCH_OK, DISPATCH_ROB, DISPATCH_LSQ, DISPATCHES };
+
+    // Why the oldest entry did not retire in a cycle
+    enum Stall { STALL_MISS, STALL_HIT, STALL_COMPUTE, STALL_ORDER, STALL_MSHR,
+                 STALL_ISSUE, STALL_EMPTY, STALLS };
+
+    struct Op {
+        Kind kind = COMPUTE;
+        uint64_t addr = 0;
+        bool issued = false;
+        bool miss = false;     // missed or waited for a miss
+        uint64_t done = 0;     // cycle it may retire
+        uint64_t mem_done = 0; // cycle its access completes
+    };
+
+    OooConfig m_config;
+    unsigned m_line_bits;
+    Access m_access;
+    uint64_t m_cycle = 0;
+
+    std::deque<Op> m_rob;
+    size_t m_lsq = 0;                  // loads and stores in the window
+    std::vector<Op> m_draining;        // retired stores still writing
+    std::unordered_map<uint64_t, uint64_t> m_outstanding; // miss line, completion
+    Dispatch m_blocked = DISPATCH_OK;
+
+    uint64_t m_retired[3] = {};
+    uint64_t m_misses = 0;
+    uint64_t m_merged = 0;
+    uint64_t m_forwarded = 0;
+    uint64_t m_mlp_sum = 0;
+    uint64_t m_mlp_cycles = 0;
+    uint64_t m_stalls[STALLS] = {};
+    uint64_t m_dispatch_stalls[DISPATCHES] = {};
+
+    size_t lsq_used() const { return m_lsq + m_draining.size(); }
+
+    // Whether an older store to the address has not issued yet, or has and
+    // can forward its data.
+    bool older_store(size_t i, bool &pending) const {
+        pending = false;
+        bool found = false;
+        for (size_t j = 0; j < i; j++) {
+            const Op &s = m_rob[j];
+            if (s.kind == STORE && s.addr == m_rob[i].addr) {
+                found = true;
+                pending = pending || !s.issued;
+            }
+        }
+        for (const Op &s : m_draining) {
+            found = found || s.addr == m_rob[i].addr;
+        }
+        return found;
+    }
+
+    // Issues the ready loads and stores, oldest first. Returns why the
+    // oldest entry could not issue, STALLS if it could.
+    Stall issue() {
+        Stall head = STALLS;
+        unsigned issued = 0;
+        for (size_t i = 0; i < m_rob.size() && issued < m_config.width; i++) {
+            Op &op = m_rob[i];
+            if (op.issued) {
+                continue;
+            }
+            bool pending;
+            if (op.kind == LOAD && older_store(i, pending)) {
+                if (pending) {
+                    head = i == 0 ? STALL_ORDER : head;
+                    continue;
+                }
+                op.issued = true;
+                op.done = op.mem_done = m_cycle + 1;
+                m_forwarded++;
+                issued++;
+                continue;
+            }
+            if (m_outstanding.size() >= m_config.mshrs) {
+                if (head == STALLS && !m_rob.front().issued) {
+                    head = STALL_MSHR;
+                }
+                break;
+            }
+
+            bool hit = m_access(op.kind == STORE, op.addr);
+            uint64_t line = op.addr >> m_line_bits;
+            auto miss = m_outstanding.find(line);
+            if (miss != m_outstanding.end()) {
+                op.mem_done = std::max<uint64_t>(m_cycle + m_config.hit_latency, miss->second);
+                op.miss = true;
+                m_merged++;
+            } else if (hit) {
+                op.mem_done = m_cycle + m_config.hit_latency;
+            } else {
+                op.mem_done = m_cycle + m_config.miss_latency;
+                op.miss = true;
+                m_outstanding[line] = op.mem_done;
+                m_misses++;
+            }
+            op.issued = true;
+            op.done = op.kind == STORE ? m_cycle + 1 : op.mem_done;
+            issued++;
+        }
+        if (head == STALLS && !m_rob.empty() && !m_rob.front().issued) {
+            head = STALL_ISSUE;
+        }
+        return head;
+    }
+
+    void retire(const Op &op) {
+        m_retired[op.kind]++;
+        if (op.kind != COMPUTE) {
+            m_lsq--;
+        }
+        if (op.kind == STORE && op.mem_done > m_cycle) {
+            m_draining.push_back(op);
+        }
+    }
+
+    Stall stall_cause(Stall head_blocked) const {
+        if (m_rob.empty()) {
+            return STALL_EMPTY;
+        }
+        const Op &head = m_rob.front();
+        if (!head.issued) {
+            return head_blocked;
+        }
+        if (head.kind == COMPUTE) {
+            return STALL_COMPUTE;
+        }
+        return head.miss ? STALL_MISS : STALL_HIT;
+    }
+};
+
+#endif
@@ -0,0 +1,142 @@
+/*
+ * File: ooo_cpu.cpp
+ *
+ * Out-of-order mode: runs the trace of one CPU on the core model of ooo.h.
+ */
+
+#include <iostream>
+#include "config.h"
+
+// Drives the out-of-order core model of ooo.h with the trace of one CPU.
+// The cache is accessed through its functional interface, the core model
+// adds the latencies, so the cache ports stay idle.
+PROFILED_MODULE(OooCpu) {
+    public:
+    sc_in<bool> Port_CLK;
+
+    FunctionalIf *functional = nullptr;
+    uint32_t cpuid = 0;
+    uint64_t fast_forward = 0;
+
+    SC_HAS_PROCESS(OooCpu);
+
+    OooCpu(sc_module_name name, const OooConfig& config)
+    : ProfiledModule(name),
+      m_core(config, OFFSET_BITS, [this](bool store, uint64_t addr) { return access(store, addr); }),
+      m_width(config.width) {
+        SC_THREAD(execute);
+        sensitive << Port_CLK.pos();
+        dont_initialize();
+    }
+
+    void print_stats() const { m_core.print(cout); }
+
+    private:
+    OooCore m_core;
+    unsigned m_width;
+
+    bool access(bool store, uint64_t addr)
+    {
+        Memory::Function f = store ? Memory::FUNC_WRITE : Memory::FUNC_READ;
+        bool hit = functional->functional_access(f, addr, true);
+        if (store)
+            hit ? stats_writehit(cpuid) : stats_writemiss(cpuid);
+        else
+            hit ? stats_readhit(cpuid) : stats_readmiss(cpuid);
+        return hit;
+    }
+
+    void execute() {
+        TraceFile::Entry tr_data;
+        bool pending = false; // tr_data did not fit in the window yet
+
+        // Warm the cache without timing for the first fast_forward accesses
+        for (uint64_t accesses = 0; accesses < fast_forward && !tracefile_ptr->eof();) {
+            if (!tracefile_ptr->next(cpuid, tr_data))
+                break;
+            if (tr_data.type == TraceFile::ENTRY_TYPE_NOP)
+                continue;
+            Memory::Function f = Memory::FUNC_ATOMIC;
+            if (tr_data.type == TraceFile::ENTRY_TYPE_READ || tr_data.waiting)
+                f = Memory::FUNC_READ;
+            else if (tr_data.type == TraceFile::ENTRY_TYPE_WRITE)
+                f = Memory::FUNC_WRITE;
+            functional->functional_access(f, tr_data.addr, false);
+            accesses++;
+        }
+
+        while (pending || !tracefile_ptr->eof() || !m_core.empty()) {
+            for (unsigned n = 0; n < m_width; n++) {
+                if (!pending) {
+                    if (tracefile_ptr->eof() || !tracefile_ptr->next(cpuid, tr_data))
+                        break;
+                    pending = true;
+                }
+                OooCore::Kind kind;
+                switch (tr_data.type) {
+                case TraceFile::ENTRY_TYPE_READ: kind = OooCore::LOAD; break;
+                case TraceFile::ENTRY_TYPE_WRITE: kind = OooCore::STORE; break;
+                case TraceFile::ENTRY_TYPE_NOP: kind = OooCore::COMPUTE; break;
+                case TraceFile::ENTRY_TYPE_ATOMIC:
+                case TraceFile::ENTRY_TYPE_LOCK:
+                case TraceFile::ENTRY_TYPE_UNLOCK:
+                case TraceFile::ENTRY_TYPE_BARRIER:
+                    // Spins are loads, the read-modify-writes need the line
+                    // exclusively like stores
+                    kind = tr_data.waiting ? OooCore::LOAD : OooCore::STORE;
+                    break;
+                default:
+                    cerr << "Error, got invalid data from Trace" << endl;
+                    exit(0);
+                }
+                if (!m_core.dispatch(kind, tr_data.addr))
+                    break;
+                pending = false;
+            }
+            m_core.cycle();
+            wait();
+        }
+
+        sc_stop();
+    }
+};
+
+// Runs CPU 0 of the trace on the out-of-order core, with the cache
+// configured as usual.
+void run_ooo(const Config& config)
+{
+    sc_clock clk("clk", sc_time(CLOCK_PERIOD_NS, SC_NS));
+    OooCpu cpu("cpu", config.ooo);
+    Cache cache("cache", config.cache);
+    cpu.functional = &cache;
+    cpu.fast_forward = config.fast_forward;
+
+    // The ports of the cache are not used, but need to be bound
+    ProfiledBuffer<Memory::Function> sigFunc, sigMemFunc;
+    ProfiledBuffer<Memory::RetCode> sigDone, sigMemDone;
+    ProfiledSignal<uint64_t> sigAddr, sigMemAddr;
+    ProfiledSignalRv<sizeof(ADDRESS_UNIT) * 32> sigData, sigMemData;
+    cache.Port_Func(sigFunc);
+    cache.Port_Addr(sigAddr);
+    cache.Port_Data(sigData);
+    cache.Port_Done(sigDone);
+    cache.Port_MemFunc(sigMemFunc);
+    cache.Port_MemAddr(sigMemAddr);
+    cache.Port_MemData(sigMemData);
+    cache.Port_MemDone(sigMemDone);
+
+    cpu.Port_CLK(clk);
+    cache.Port_CLK(clk);
+
+    cout << "Running (press CTRL+C to interrupt)... " << endl;
+    if (config.profile)
+        KernelProfile::enable();
+    sc_start();
+
+    stats_print();
+    KernelProfile::print();
+    MissClassifier::print_cpus({{cache.cpuid, &cache.misses()}});
+    // The core model accesses the cache functionally, which moves no data
+    cache.print_stats(false);
+    cpu.print_stats();
+}
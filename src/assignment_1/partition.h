@@ -0,0 +1,322 @@
+/*
+ * File: partition.h
+ *
+ * Way-partitioning of a cache shared by several programs. With static
+ * partitioning every program gets a fixed number of ways in every set; with
+ * utility-based cache partitioning (UCP, Qureshi and Patt, MICRO 2006) the
+ * ways are redistributed periodically according to utility monitors: shadow
+ * tags of a sample of the sets that count the hits per LRU stack position,
+ * so the hits a program would get with any number of ways are known. The
+ * unmanaged policy is plain LRU over all programs.
+ */
+
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+enum PartitionPolicy { PARTITION_NONE, PARTITION_STATIC, PARTITION_UCP };
+
+static inline PartitionPolicy parse_partition_policy(const std::string &name) {
+    if (name == "none") return PARTITION_NONE;
+    if (name == "static") return PARTITION_STATIC;
+    if (name == "ucp") return PARTITION_UCP;
+    throw std::runtime_error("Error, unknown partitioning policy " + name);
+}
+
+static inline const char *partition_policy_name(PartitionPolicy p) {
+    static const char *names[] = {"unmanaged", "static", "UCP"};
+    return names[p];
+}
+
+// Utility monitor of one program: LRU shadow tags of every sample-th set,
+// with hit counters per stack position.
+class UtilityMonitor {
+    public:
+    UtilityMonitor(size_t sets, size_t ways, size_t sample)
+    : m_sets(sets), m_ways(ways), m_sample(sample),
+      m_tags((sets + sample - 1) / sample * ways, 0), m_hits(ways, 0) {}
+
+    void access(uint64_t line) {
+        size_t set = line % m_sets;
+        if (set % m_sample) {
+            return;
+        }
+        auto first = m_tags.begin() + set / m_sample * m_ways;
+        auto last = first + m_ways;
+        auto it = std::find(first, last, line + 1);
+        if (it != last) {
+            m_hits[it - first]++;
+        } else {
+            it = last - 1;
+            *it = line + 1;
+        }
+        std::rotate(first, it, it + 1);
+    }
+
+    // Hits the program would have had with the given number of ways
+    uint64_t hits(size_t ways) const {
+        uint64_t n = 0;
+        for (size_t w = 0; w < ways && w < m_ways; w++) {
+            n += m_hits[w];
+        }
+        return n;
+    }
+
+    // Ages the counters so recent behaviour weighs more.
+    void decay() {
+        for (uint64_t &h : m_hits) {
+            h /= 2;
+        }
+    }
+
+    private:
+    size_t m_sets;
+    size_t m_ways;
+    size_t m_sample;
+    std::vector<uint64_t> m_tags; // line plus one, most recent first per set
+    std::vector<uint64_t> m_hits;
+};
+
+/*
+ * Decides how many ways of every set each program may hold, and keeps the
+ * per-program statistics of the shared cache. One partitioner is shared by
+ * all banks of the cache, so the allocation is the same in every set.
+ */
+class WayPartitioner {
+    public:
+    // Sets in a monitor when the sets are sampled
+    static constexpr size_t MONITOR_SETS = 32;
+
+    WayPartitioner(PartitionPolicy policy, size_t programs, size_t sets, size_t ways,
+                   const std::vector<size_t> &static_ways, uint64_t interval)
+    : m_policy(policy), m_ways(ways), m_interval(interval), m_stats(programs) {
+        if (policy == PARTITION_STATIC) {
+            if (static_ways.size() != programs) {
+                throw std::runtime_error("Error, static partitioning needs the ways of every program");
+            }
+            size_t total = 0;
+            for (size_t w : static_ways) {
+                if (w == 0) {
+                    throw std::runtime_error("Error, every program needs at least one way");
+                }
+                total += w;
+            }
+            if (total > ways) {
+                throw std::runtime_error("Error, the partitions have more ways than the cache");
+            }
+            m_allocation = static_ways;
+        }
+        if (policy == PARTITION_UCP) {
+            if (programs > ways) {
+                throw std::runtime_error("Error, UCP needs at least one way per program");
+            }
+            size_t sample = std::max<size_t>(1, sets / MONITOR_SETS);
+            for (size_t p = 0; p < programs; p++) {
+                m_monitors.emplace_back(sets, ways, sample);
+            }
+            // Start from an even split
+            m_allocation.assign(programs, ways / programs);
+            for (size_t p = 0; p < ways % programs; p++) {
+                m_allocation[p]++;
+            }
+        }
+    }
+
+    bool managed() const { return m_policy != PARTITION_NONE; }
+
+    // Ways of every set that the program may hold
+    size_t allocation(size_t program) const { return m_allocation[program]; }
+
+    // Records an access of the shared cache by a program.
+    void access(uint64_t line, size_t program, bool hit, bool count) {
+        if (m_policy == PARTITION_UCP) {
+            m_monitors[program].access(line);
+        }
+        if (count) {
+            Stats &s = m_stats[program];
+            s.accesses++;
+            s.hits += hit;
+            for (size_t p = 0; p < m_stats.size(); p++) {
+                m_stats[p].way_accesses += managed() ? m_allocation[p] : 0;
+            }
+        }
+        if (m_policy == PARTITION_UCP && ++m_since_repartition >= m_interval) {
+            repartition();
+        }
+    }
+
+    uint64_t accesses(size_t program) const { return m_stats[program].accesses; }
+    uint64_t hits(size_t program) const { return m_stats[program].hits; }
+
+    // Average number of ways the program held, over all counted accesses
+    double average_ways(size_t program) const {
+        uint64_t accesses = 0;
+        for (const Stats &s : m_stats) {
+            accesses += s.accesses;
+        }
+        return accesses ? (double)m_stats[program].way_accesses / accesses : 0.0;
+    }
+
+    void print() const {
+        using namespace std;
+        cout << "Shared cache partitioning (" << partition_policy_name(m_policy);
+        if (m_policy == PARTITION_UCP) {
+            cout << ", repartitioned " << m_repartitions << " times";
+        }
+        cout << "):" << endl;
+        if (!managed()) {
+            return;
+        }
+        for (size_t p = 0; p < m_allocation.size(); p++) {
+            cout << "  Program " << p << ": " << m_allocation[p] << " of " << m_ways
+                 << " ways, " << setprecision(3) << average_ways(p)
+                 << " on average" << endl;
+        }
+    }
+
+    private:
+    struct Stats {
+        uint64_t accesses = 0;
+        uint64_t hits = 0;
+        uint64_t way_accesses = 0; // sum of the allocation over all accesses
+    };
+
+    PartitionPolicy m_policy;
+    size_t m_ways;
+    uint64_t m_interval;
+    std::vector<size_t> m_allocation;
+    std::vector<UtilityMonitor> m_monitors;
+    std::vector<Stats> m_stats;
+    uint64_t m_since_repartition = 0;
+    uint64_t m_repartitions = 0;
+
+    // The lookahead algorithm of UCP: every program keeps one way, the
+    // others go one block at a time to the program with the highest
+    // marginal utility (extra hits per extra way) for any block size.
+    void repartition() {
+        size_t programs = m_monitors.size();
+        std::vector<size_t> alloc(programs, 1);
+        size_t balance = m_ways - programs;
+        while (balance > 0) {
+            double best_mu = -1.0;
+            size_t best_p = 0;
+            size_t best_k = 1;
+            for (size_t p = 0; p < programs; p++) {
+                uint64_t base = m_monitors[p].hits(alloc[p]);
+                for (size_t k = 1; k <= balance; k++) {
+                    double mu = (double)(m_monitors[p].hits(alloc[p] + k) - base) / k;
+                    if (mu > best_mu) {
+                        best_mu = mu;
+                        best_p = p;
+                        best_k = k;
+                    }
+                }
+            }
+            alloc[best_p] += best_k;
+            balance -= best_k;
+        }
+        m_allocation = alloc;
+        for (UtilityMonitor &m : m_monitors) {
+            m.decay();
+        }
+        m_since_repartition = 0;
+        m_repartitions++;
+    }
+};
+
+/*
+ * Tag store of one bank of the shared cache, LRU within the partitions of
+ * the partitioner. On a miss a program below its allocation takes the LRU
+ * line of a program above its allocation, otherwise it replaces its own LRU
+ * line.
+ */
+class PartitionedTags {
+    public:
+    PartitionedTags(size_t sets, size_t ways, WayPartitioner &partitioner)
+    : m_sets(sets), m_ways(ways), m_lines(sets * ways), m_partitioner(partitioner) {}
+
+    // Returns whether the line was present and makes it the most recent one.
+    bool access(uint64_t line, size_t program) {
+        m_clock++;
+        auto first = m_lines.begin() + (line % m_sets) * m_ways;
+        auto last = first + m_ways;
+        for (auto it = first; it != last; ++it) {
+            if (it->valid && it->line == line) {
+                it->last_use = m_clock;
+                return true;
+            }
+        }
+        Line &victim = replace(first, last, program);
+        victim = {line, program, m_clock, true};
+        return false;
+    }
+
+    private:
+    struct Line {
+        uint64_t line = 0;
+        size_t owner = 0;
+        uint64_t last_use = 0;
+        bool valid = false;
+    };
+    using Iter = std::vector<Line>::iterator;
+
+    size_t m_sets;
+    size_t m_ways;
+    std::vector<Line> m_lines;
+    WayPartitioner &m_partitioner;
+    uint64_t m_clock = 0;
+
+    Line &replace(Iter first, Iter last, size_t program) {
+        for (auto it = first; it != last; ++it) {
+            if (!it->valid) {
+                return *it;
+            }
+        }
+        if (!m_partitioner.managed()) {
+            return *lru(first, last, [](const Line &) { return true; });
+        }
+
+        std::vector<size_t> owned;
+        for (auto it = first; it != last; ++it) {
+            if (it->owner >= owned.size()) {
+                owned.resize(it->owner + 1, 0);
+            }
+            owned[it->owner]++;
+        }
+        owned.resize(std::max(owned.size(), program + 1), 0);
+        auto over = [&](const Line &l) {
+            return l.owner != program && owned[l.owner] > m_partitioner.allocation(l.owner);
+        };
+        if (owned[program] < m_partitioner.allocation(program)) {
+            auto it = lru(first, last, over);
+            if (it != last) {
+                return *it;
+            }
+        }
+        auto it = lru(first, last, [&](const Line &l) { return l.owner == program; });
+        if (it != last) {
+            return *it;
+        }
+        return *lru(first, last, [](const Line &) { return true; });
+    }
+
+    template <typename F>
+    static Iter lru(Iter first, Iter last, F candidate) {
+        Iter best = last;
+        for (auto it = first; it != last; ++it) {
+            if (candidate(*it) && (best == last || it->last_use < best->last_use)) {
+                best = it;
+            }
+        }
+        return best;
+    }
+};
+
+#endif
@@ -0,0 +1,226 @@
+/*
+ * File: profile.h
+ *
+ * Self-profiling of the simulator, to see where the host time of a run
+ * goes. Every profiled module has one thread; it counts how often the
+ * thread resumed, in how many delta cycles it ran, the signal writes it made
+ * and the events those writes notified, and the host time the thread ran
+ * between waits, read from the time stamp counter. What is left of the run
+ * is spent in the kernel: scheduling, signal updates and the resolution of
+ * the rv buses. Counting is off unless enabled, since it reads the counter
+ * on every wait.
+ *
+ * Modules are profiled by deriving from ProfiledModule, whose wait() hides
+ * the one of sc_module, and signal writes by using the profiled channels.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <systemc>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Host time stamp, the TSC where there is one
+static inline uint64_t profile_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+struct ProfileCounters {
+    uint64_t resumes = 0;
+    uint64_t deltas = 0;  // delta cycles the thread ran in
+    uint64_t writes = 0;
+    uint64_t events = 0;  // writes that notified the value changed event
+    uint64_t ticks = 0;   // host time running
+    uint64_t last_delta = UINT64_MAX;
+    uint64_t resumed_at = 0;
+};
+
+class ProfiledModule;
+
+class KernelProfile {
+    public:
+    static bool enabled() { return state().enabled; }
+
+    // Starts counting, before the simulation starts.
+    static void enable() {
+        State &s = state();
+        s.enabled = true;
+        s.start_ticks = profile_ticks();
+        s.start_time = std::chrono::steady_clock::now();
+        s.start_delta = sc_core::sc_delta_count();
+    }
+
+    static void add(ProfiledModule *module) { state().modules.push_back(module); }
+
+    static void remove(ProfiledModule *module) {
+        std::vector<ProfiledModule *> &modules = state().modules;
+        modules.erase(std::remove(modules.begin(), modules.end(), module), modules.end());
+    }
+
+    // Module of the running thread, if it is profiled
+    static ProfiledModule *current();
+
+    static void print();
+
+    private:
+    struct State {
+        bool enabled = false;
+        uint64_t start_ticks = 0;
+        std::chrono::steady_clock::time_point start_time;
+        uint64_t start_delta = 0;
+        std::vector<ProfiledModule *> modules;
+    };
+
+    static State &state() {
+        static State s;
+        return s;
+    }
+
+    static std::string fixed2(double x) {
+        std::ostringstream s;
+        s << std::fixed << std::setprecision(2) << x;
+        return s.str();
+    }
+};
+
+class ProfiledModule : public sc_core::sc_module {
+    public:
+    ProfileCounters profile;
+
+    protected:
+    ProfiledModule() { KernelProfile::add(this); }
+    ProfiledModule(sc_core::sc_module_name name) : sc_module(name) { KernelProfile::add(this); }
+    ~ProfiledModule() { KernelProfile::remove(this); }
+
+    template <typename... Args>
+    void wait(Args &&...args) {
+        if (!KernelProfile::enabled()) {
+            sc_module::wait(std::forward<Args>(args)...);
+            return;
+        }
+        // The thread starts running before its first wait, not from a resume
+        if (profile.resumed_at) {
+            profile.ticks += profile_ticks() - profile.resumed_at;
+        }
+        sc_module::wait(std::forward<Args>(args)...);
+        profile.resumed_at = profile_ticks();
+        profile.resumes++;
+        uint64_t delta = sc_core::sc_delta_count();
+        profile.deltas += delta != profile.last_delta;
+        profile.last_delta = delta;
+    }
+};
+
+inline ProfiledModule *KernelProfile::current() {
+    sc_core::sc_process_handle process = sc_core::sc_get_current_process_handle();
+    if (!process.valid()) {
+        return nullptr;
+    }
+    return dynamic_cast<ProfiledModule *>(process.get_parent_object());
+}
+
+// Declares a profiled module, as SC_MODULE declares a plain one.
+#define PROFILED_MODULE(name) struct name : ProfiledModule
+
+/*
+ * A channel that counts the writes of the profiled threads and the events
+ * they cause. An event is notified when the update changes the value, or
+ * on every update of a buffer.
+ */
+template <class Channel, bool always_notifies = false>
+class ProfiledChannel : public Channel {
+    public:
+    using Value = typename std::decay<decltype(std::declval<Channel>().read())>::type;
+    using Channel::write;
+
+    void write(const Value &value) override {
+        if (KernelProfile::enabled()) {
+            m_writer = KernelProfile::current();
+            if (m_writer) {
+                m_writer->profile.writes++;
+            }
+        }
+        Channel::write(value);
+    }
+
+    protected:
+    void update() override {
+        if (!m_writer) {
+            Channel::update();
+            return;
+        }
+        Value old = this->read();
+        Channel::update();
+        if (always_notifies || !(this->read() == old)) {
+            m_writer->profile.events++;
+        }
+        m_writer = nullptr;
+    }
+
+    private:
+    ProfiledModule *m_writer = nullptr; // last writer before the update
+};
+
+template <class T>
+using ProfiledSignal = ProfiledChannel<sc_core::sc_signal<T>>;
+template <class T>
+using ProfiledBuffer = ProfiledChannel<sc_core::sc_buffer<T>, true>;
+template <int W>
+using ProfiledSignalRv = ProfiledChannel<sc_core::sc_signal_rv<W>>;
+
+// One row per module, the most host time first, and the kernel's share.
+inline void KernelProfile::print() {
+    using namespace std;
+    State &s = state();
+    if (!s.enabled) {
+        return;
+    }
+    uint64_t ticks = profile_ticks() - s.start_ticks;
+    double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - s.start_time).count();
+    double ms_per_tick = ticks ? ns / ticks / 1e6 : 0.0;
+
+    vector<ProfiledModule *> modules = s.modules;
+    stable_sort(modules.begin(), modules.end(), [](ProfiledModule *a, ProfiledModule *b) {
+        return a->profile.ticks > b->profile.ticks;
+    });
+    uint64_t threads = 0;
+    for (ProfiledModule *m : modules) {
+        threads += m->profile.ticks;
+    }
+
+    auto row = [&](double share) {
+        cout << setw(12) << fixed2(share * ticks * ms_per_tick) << setw(9)
+             << fixed2(100.0 * share) << "%" << endl;
+    };
+    cout << "Kernel profile (" << sc_core::sc_delta_count() - s.start_delta
+         << " delta cycles, " << fixed2(ns / 1e6) << " ms host time):" << endl;
+    cout << setw(16) << "Module" << setw(10) << "Resumes" << setw(10) << "Deltas"
+         << setw(10) << "Writes" << setw(10) << "Events" << setw(12) << "Host ms"
+         << setw(10) << "Host%" << endl;
+    for (ProfiledModule *m : modules) {
+        const ProfileCounters &p = m->profile;
+        cout << setw(16) << m->name() << setw(10) << p.resumes << setw(10) << p.deltas
+             << setw(10) << p.writes << setw(10) << p.events;
+        row(ticks ? (double)p.ticks / ticks : 0.0);
+    }
+    cout << setw(56) << "(kernel)";
+    row(ticks && threads < ticks ? (double)(ticks - threads) / ticks : 0.0);
+}
+
+#endif
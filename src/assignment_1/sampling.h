@@ -0,0 +1,167 @@
+/*
+ * File: sampling.h
+ *
+ * Helpers for SMARTS-style statistical sampling. A run is divided in periods
+ * of `interval` memory accesses. Most of a period is fast-forwarded with
+ * functional warming (tags and LRU state only); the last `warmup + size`
+ * accesses are simulated in detail and only the final `size` accesses are
+ * measured. Every measured window gives one sample of the AMAT and hit rate,
+ * from which the mean and a confidence interval are derived.
+ */
+
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+
+#include "checkpoint.h"
+
+// Welford's running mean/variance over a series of samples.
+class RunningStat {
+    public:
+    void add(double x) {
+        m_n++;
+        double delta = x - m_mean;
+        m_mean += delta / m_n;
+        m_m2 += delta * (x - m_mean);
+    }
+
+    uint64_t count() const { return m_n; }
+    double mean() const { return m_mean; }
+    double variance() const { return m_n > 1 ? m_m2 / (m_n - 1) : 0.0; }
+    double stddev() const { return std::sqrt(variance()); }
+
+    // Half width of the confidence interval of the mean for given z-score.
+    double ci(double z) const {
+        return m_n > 1 ? z * stddev() / std::sqrt((double)m_n) : 0.0;
+    }
+
+    void save(CheckpointWriter &out) const {
+        out.write(m_n);
+        out.write(m_mean);
+        out.write(m_m2);
+    }
+
+    void restore(CheckpointReader &in) {
+        m_n = in.read<uint64_t>();
+        m_mean = in.read<double>();
+        m_m2 = in.read<double>();
+    }
+
+    private:
+    uint64_t m_n = 0;
+    double m_mean = 0.0;
+    double m_m2 = 0.0;
+};
+
+class Sampler {
+    public:
+    enum Phase { PHASE_WARM, PHASE_DETAILED_WARMUP, PHASE_MEASURE };
+
+    // z-score of the reported two-sided 95% confidence interval
+    static constexpr double Z_95 = 1.96;
+
+    Sampler(uint64_t interval, uint64_t size, uint64_t warmup)
+    : m_interval(interval), m_size(size), m_warmup(warmup) {}
+
+    bool enabled() const { return m_interval > 0; }
+
+    // Phase of the n-th memory access (counting from zero).
+    Phase phase(uint64_t n) const {
+        if (!enabled()) {
+            return PHASE_MEASURE;
+        }
+        uint64_t pos = n % m_interval;
+        if (pos >= m_interval - m_size) {
+            return PHASE_MEASURE;
+        }
+        if (pos >= m_interval - m_size - m_warmup) {
+            return PHASE_DETAILED_WARMUP;
+        }
+        return PHASE_WARM;
+    }
+
+    // Is the n-th memory access the last one of a measurement window?
+    bool window_end(uint64_t n) const {
+        return enabled() && (n % m_interval) == m_interval - 1;
+    }
+
+    // Records the latency (in cycles) of one measured access.
+    void record(double cycles) {
+        m_latency += cycles;
+        m_accesses++;
+    }
+
+    // Closes the current measurement window, hits is the number of cache
+    // hits that were counted during the window.
+    void close_window(uint64_t hits) {
+        if (m_accesses == 0) {
+            return;
+        }
+        m_amat.add(m_latency / m_accesses);
+        m_hitrate.add(hits / (double)m_accesses);
+        m_latency = 0.0;
+        m_accesses = 0;
+    }
+
+    void print() const {
+        std::cout << "Sampling: " << m_amat.count() << " windows of " << m_size
+                  << " accesses every " << m_interval << " accesses ("
+                  << m_warmup << " detailed warm-up)" << std::endl;
+        if (m_amat.count() < 2) {
+            std::cout << "Not enough windows for a confidence interval" << std::endl;
+            return;
+        }
+        std::cout << std::fixed << std::setprecision(3);
+        std::cout << "AMAT:     " << m_amat.mean() << " +/- "
+                  << m_amat.ci(Z_95) << " cycles (95% CI)" << std::endl;
+        std::cout << "Hit rate: " << m_hitrate.mean() * 100 << " +/- "
+                  << m_hitrate.ci(Z_95) * 100 << " % (95% CI)" << std::endl;
+        // Number of windows needed for a +/-3% error on the AMAT.
+        if (m_amat.mean() > 0) {
+            double cv = m_amat.stddev() / m_amat.mean();
+            double needed = std::ceil(std::pow(Z_95 * cv / 0.03, 2));
+            std::cout << "Windows needed for +/-3% AMAT error: " << (uint64_t)needed
+                      << std::endl;
+        }
+        std::cout << std::defaultfloat;
+    }
+
+    // The windows measured so far and the one that is open. A checkpoint
+    // can only be restored with the same sampling parameters.
+    void save(CheckpointWriter &out) const {
+        out.write(m_interval);
+        out.write(m_size);
+        out.write(m_warmup);
+        out.write(m_latency);
+        out.write(m_accesses);
+        m_amat.save(out);
+        m_hitrate.save(out);
+    }
+
+    void restore(CheckpointReader &in) {
+        in.expect(m_interval, "the sample interval");
+        in.expect(m_size, "the sample size");
+        in.expect(m_warmup, "the sample warm-up");
+        m_latency = in.read<double>();
+        m_accesses = in.read<uint64_t>();
+        m_amat.restore(in);
+        m_hitrate.restore(in);
+    }
+
+    private:
+    uint64_t m_interval;
+    uint64_t m_size;
+    uint64_t m_warmup;
+
+    double m_latency = 0.0;
+    uint64_t m_accesses = 0;
+
+    RunningStat m_amat;
+    RunningStat m_hitrate;
+};
+
+#endif
@@ -0,0 +1,99 @@
+/*
+ * File: sector.h
+ *
+ * Statistics of a sectored cache, where one tag covers a line of several
+ * sectors that are filled and written back separately, each with a valid and
+ * a dirty bit of its own. A miss either finds no tag for the line (a tag
+ * miss, which replaces a whole line) or finds the tag without the sector (a
+ * sector miss, which only fetches the sector). The traffic is compared with
+ * what a cache of unsectored lines of the same size would move for the same
+ * tag misses: a whole line per fill and per dirty eviction.
+ */
+
+#ifndef SECTOR_H
+#define SECTOR_H
+
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+
+#include "checkpoint.h"
+
+class SectorStats {
+    public:
+    SectorStats(size_t sectors, size_t sector_size)
+    : m_sectors(sectors), m_sector_size(sector_size) {}
+
+    void tag_miss() { m_tag_misses++; }
+    void sector_miss() { m_sector_misses++; }
+    void fill() { m_filled++; }
+    void write_back() { m_written++; }
+
+    // A line leaves the cache with the given number of valid sectors.
+    void evict(unsigned valid, bool dirty) {
+        m_lines++;
+        m_valid += valid;
+        m_dirty_lines += dirty;
+    }
+
+    // The lines still in the cache count towards the utilization too.
+    void print(const char *name, size_t tags, uint64_t resident_lines,
+               uint64_t resident_sectors) const {
+        using namespace std;
+        uint64_t lines = m_lines + resident_lines;
+        double valid = lines ? (double)(m_valid + resident_sectors) / lines : 0.0;
+        uint64_t line_size = m_sectors * m_sector_size;
+        uint64_t fetched = m_filled * m_sector_size;
+        uint64_t fetched_whole = m_tag_misses * line_size;
+        uint64_t written = m_written * m_sector_size;
+        uint64_t written_whole = m_dirty_lines * line_size;
+
+        cout << "Sectored lines (" << name << ", " << m_sectors << " sectors of "
+             << m_sector_size << " bytes, " << tags << " tags instead of "
+             << tags * m_sectors << "):" << endl;
+        cout << "  Misses: " << m_tag_misses << " tag misses, " << m_sector_misses
+             << " sector misses" << endl;
+        cout << "  Sector utilization: " << setprecision(3) << valid << " of "
+             << m_sectors << " sectors valid per line ("
+             << 100.0 * valid / m_sectors << "%) over " << lines << " lines" << endl;
+        cout << "  Fetched " << fetched << " bytes, " << fetched_whole
+             << " with whole lines (" << (int64_t)(fetched_whole - fetched)
+             << " saved)" << endl;
+        cout << "  Written back " << written << " bytes, " << written_whole
+             << " with whole lines (" << (int64_t)(written_whole - written)
+             << " saved)" << endl;
+    }
+
+    void save(CheckpointWriter &out) const {
+        out.write(m_tag_misses);
+        out.write(m_sector_misses);
+        out.write(m_filled);
+        out.write(m_written);
+        out.write(m_lines);
+        out.write(m_valid);
+        out.write(m_dirty_lines);
+    }
+
+    void restore(CheckpointReader &in) {
+        m_tag_misses = in.read<uint64_t>();
+        m_sector_misses = in.read<uint64_t>();
+        m_filled = in.read<uint64_t>();
+        m_written = in.read<uint64_t>();
+        m_lines = in.read<uint64_t>();
+        m_valid = in.read<uint64_t>();
+        m_dirty_lines = in.read<uint64_t>();
+    }
+
+    private:
+    size_t m_sectors;
+    size_t m_sector_size;
+    uint64_t m_tag_misses = 0;
+    uint64_t m_sector_misses = 0;
+    uint64_t m_filled = 0;      // sectors fetched
+    uint64_t m_written = 0;     // sectors written back
+    uint64_t m_lines = 0;       // lines evicted
+    uint64_t m_valid = 0;       // valid sectors of the evicted lines
+    uint64_t m_dirty_lines = 0; // evicted lines with a dirty sector
+};
+
+#endif
@@ -0,0 +1,131 @@
+/*
+ * File: sync.h
+ *
+ * Synchronization statistics of a CPU: the atomic accesses, lock acquires
+ * and releases and barriers of its trace, how often it had to wait for a
+ * lock, the reads of lock and barrier words while waiting (spins), and the
+ * cycles spent on each kind of synchronization, waiting included.
+ */
+
+#ifndef SYNC_H
+#define SYNC_H
+
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "psa.h"
+
+class SyncStats {
+    public:
+    uint64_t atomics = 0;
+    uint64_t acquires = 0;
+    uint64_t contended = 0;  // acquires that found the lock taken
+    uint64_t releases = 0;
+    uint64_t barriers = 0;
+    uint64_t spins = 0;
+    uint64_t atomic_cycles = 0;
+    uint64_t lock_cycles = 0;    // acquiring, waiting included, and releasing
+    uint64_t barrier_cycles = 0; // arriving and waiting
+    uint64_t cycles = 0;         // cycles until the trace of the CPU ended
+
+    // Records a synchronization entry of the trace that took the given
+    // number of cycles.
+    void record(const TraceFile::Entry &e, uint64_t entry_cycles) {
+        if (e.waiting) {
+            spins++;
+            contended += e.type == TraceFile::ENTRY_TYPE_LOCK && !m_waiting;
+        }
+        m_waiting = e.waiting;
+
+        switch (e.type) {
+        case TraceFile::ENTRY_TYPE_ATOMIC:
+            atomics++;
+            atomic_cycles += entry_cycles;
+            break;
+        case TraceFile::ENTRY_TYPE_LOCK:
+            acquires += !e.waiting;
+            lock_cycles += entry_cycles;
+            break;
+        case TraceFile::ENTRY_TYPE_UNLOCK:
+            releases++;
+            lock_cycles += entry_cycles;
+            break;
+        case TraceFile::ENTRY_TYPE_BARRIER:
+            barriers += !e.waiting;
+            barrier_cycles += entry_cycles;
+            break;
+        default:
+            break;
+        }
+    }
+
+    bool any() const { return atomics + acquires + barriers + spins > 0; }
+
+    void save(CheckpointWriter &out) const {
+        out.write(atomics);
+        out.write(acquires);
+        out.write(contended);
+        out.write(releases);
+        out.write(barriers);
+        out.write(spins);
+        out.write(atomic_cycles);
+        out.write(lock_cycles);
+        out.write(barrier_cycles);
+        out.write((uint8_t)m_waiting);
+    }
+
+    void restore(CheckpointReader &in) {
+        atomics = in.read<uint64_t>();
+        acquires = in.read<uint64_t>();
+        contended = in.read<uint64_t>();
+        releases = in.read<uint64_t>();
+        barriers = in.read<uint64_t>();
+        spins = in.read<uint64_t>();
+        atomic_cycles = in.read<uint64_t>();
+        lock_cycles = in.read<uint64_t>();
+        barrier_cycles = in.read<uint64_t>();
+        m_waiting = in.read<uint8_t>();
+    }
+
+    // One row per CPU, nothing if no CPU synchronized.
+    static void print_cpus(const std::vector<std::pair<uint32_t, const SyncStats *>> &cpus) {
+        using namespace std;
+        bool any = false;
+        for (auto &c : cpus) {
+            any = any || c.second->any();
+        }
+        if (!any) {
+            return;
+        }
+        cout << "Synchronization:" << endl;
+        cout << setw(10) << "CPU" << setw(10) << "Atomics" << setw(10) << "Locks"
+             << setw(11) << "Contended" << setw(10) << "Spins" << setw(10)
+             << "Barriers" << setw(12) << "AtomicCyc" << setw(12) << "LockCyc"
+             << setw(12) << "BarrierCyc" << setw(10) << "Sync%" << endl;
+        for (auto &c : cpus) {
+            const SyncStats &s = *c.second;
+            uint64_t sync = s.atomic_cycles + s.lock_cycles + s.barrier_cycles;
+            cout << setw(10) << c.first << setw(10) << s.atomics << setw(10)
+                 << s.acquires << setw(11) << s.contended << setw(10) << s.spins
+                 << setw(10) << s.barriers << setw(12) << s.atomic_cycles
+                 << setw(12) << s.lock_cycles << setw(12) << s.barrier_cycles
+                 << setw(10) << percentage(sync, s.cycles) << endl;
+        }
+    }
+
+    private:
+    bool m_waiting = false; // the previous entry was a spin
+
+    static std::string percentage(uint64_t n, uint64_t total) {
+        std::ostringstream s;
+        s << std::fixed << std::setprecision(2) << (total ? 100.0 * n / total : 0.0) << "%";
+        return s.str();
+    }
+};
+
+#endif
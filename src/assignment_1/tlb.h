@@ -0,0 +1,167 @@
+/*
+ * File: tlb.h
+ *
+ * Address translation structures used by the Mmu module: set-associative
+ * TLBs with LRU replacement and the layout of a multi-level radix page table.
+ * Virtual pages are mapped to the physical frame with the same number, so
+ * enabling translation only adds its cost and does not change which lines
+ * conflict in the caches. The page tables live in a reserved physical region
+ * and their entries are read through the cache hierarchy during a walk.
+ */
+
+#ifndef TLB_H
+#define TLB_H
+
+#include <cstdint>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "checkpoint.h"
+
+struct TlbConfig {
+    bool enabled = false;
+    uint64_t page_size = 4096;
+    size_t l1_entries = 64;
+    size_t l1_ways = 4;
+    size_t l2_entries = 1024;
+    size_t l2_ways = 8;
+    unsigned l2_latency = 7; // extra cycles for an L1 miss that hits the L2
+};
+
+class Tlb {
+    public:
+    Tlb(size_t entries, size_t ways) : m_ways(ways), m_entries(entries) {
+        if (ways == 0 || entries == 0 || entries % ways) {
+            throw std::runtime_error("Error, TLB entries must be a multiple of its ways");
+        }
+        m_sets = entries / ways;
+    }
+
+    // Looks up a virtual page number, updates the LRU state on a hit.
+    bool lookup(uint64_t vpn, uint64_t &pfn) {
+        Entry *set = &m_entries[(vpn % m_sets) * m_ways];
+        for (size_t way = 0; way < m_ways; way++) {
+            if (set[way].valid && set[way].vpn == vpn) {
+                set[way].last_use = ++m_clock;
+                pfn = set[way].pfn;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Installs a translation, replacing an invalid or the LRU entry.
+    void insert(uint64_t vpn, uint64_t pfn) {
+        Entry *set = &m_entries[(vpn % m_sets) * m_ways];
+        Entry *victim = &set[0];
+        for (size_t way = 0; way < m_ways; way++) {
+            if (!set[way].valid) {
+                victim = &set[way];
+                break;
+            }
+            if (set[way].last_use < victim->last_use) {
+                victim = &set[way];
+            }
+        }
+        *victim = Entry{vpn, pfn, true, ++m_clock};
+    }
+
+    void save(CheckpointWriter &out) const {
+        out.write((uint64_t)m_entries.size());
+        out.write(m_clock);
+        for (const Entry &e : m_entries) {
+            out.write(e);
+        }
+    }
+
+    void restore(CheckpointReader &in) {
+        in.expect((uint64_t)m_entries.size(), "the number of TLB entries");
+        m_clock = in.read<uint64_t>();
+        for (Entry &e : m_entries) {
+            e = in.read<Entry>();
+        }
+    }
+
+    private:
+    struct Entry {
+        uint64_t vpn;
+        uint64_t pfn;
+        bool valid;
+        uint64_t last_use;
+    };
+
+    size_t m_ways;
+    size_t m_sets;
+    uint64_t m_clock = 0;
+    std::vector<Entry> m_entries;
+};
+
+/*
+ * x86-64 style radix page table: 48-bit virtual addresses, 512 eight byte
+ * entries per table and as many levels as needed above the page offset, so
+ * 4 levels for 4 KB pages and 3 for 2 MB pages. Tables are allocated on
+ * first use from the page table region.
+ */
+class PageTable {
+    public:
+    static constexpr unsigned VA_BITS = 48;
+    static constexpr unsigned LEVEL_BITS = 9;
+    static constexpr uint64_t PTE_SIZE = 8;
+    static constexpr uint64_t TABLE_SIZE = PTE_SIZE << LEVEL_BITS;
+    static constexpr uint64_t TABLE_REGION = 1ULL << 60;
+
+    explicit PageTable(uint64_t page_size) {
+        if (page_size < 4096 || (page_size & (page_size - 1))) {
+            throw std::runtime_error("Error, page size must be a power of two of at least 4096");
+        }
+        while ((1ULL << m_page_bits) < page_size) {
+            m_page_bits++;
+        }
+        m_levels = (VA_BITS - m_page_bits + LEVEL_BITS - 1) / LEVEL_BITS;
+    }
+
+    unsigned page_bits() const { return m_page_bits; }
+    unsigned levels() const { return m_levels; }
+
+    // Address of the entry that level (0 is the root) reads for vaddr.
+    uint64_t pte_address(unsigned level, uint64_t vaddr) {
+        unsigned shift = m_page_bits + LEVEL_BITS * (m_levels - 1 - level);
+        uint64_t index = (vaddr >> shift) & ((1ULL << LEVEL_BITS) - 1);
+        // The table is identified by its level and the bits above its index
+        uint64_t key = ((uint64_t)level << 56) | (vaddr >> (shift + LEVEL_BITS));
+        auto it = m_tables.find(key);
+        if (it == m_tables.end()) {
+            it = m_tables.emplace(key, TABLE_REGION + m_tables.size() * TABLE_SIZE).first;
+        }
+        return it->second + index * PTE_SIZE;
+    }
+
+    // Physical frame of a virtual page, pages are identity mapped
+    uint64_t frame(uint64_t vpn) const { return vpn; }
+
+    size_t tables() const { return m_tables.size(); }
+
+    void save(CheckpointWriter &out) const {
+        out.write((uint64_t)m_tables.size());
+        for (auto &t : m_tables) {
+            out.write(t.first);
+            out.write(t.second);
+        }
+    }
+
+    void restore(CheckpointReader &in) {
+        m_tables.clear();
+        for (uint64_t n = in.read<uint64_t>(); n > 0; n--) {
+            uint64_t key = in.read<uint64_t>();
+            m_tables[key] = in.read<uint64_t>();
+        }
+    }
+
+    private:
+    unsigned m_page_bits = 0;
+    unsigned m_levels;
+    std::unordered_map<uint64_t, uint64_t> m_tables;
+};
+
+#endif
@@ -0,0 +1,171 @@
+/*
+ * File: write_policy.h
+ *
+ * Support for the write policies of the cache: a write-combining buffer that
+ * gathers stores sent to memory into line-sized writes, and the memory
+ * traffic counters used to compare the policies. Trace stores carry no size,
+ * so every store is counted as one word of STORE_BYTES.
+ */
+
+#ifndef WRITE_POLICY_H
+#define WRITE_POLICY_H
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "checkpoint.h"
+
+static constexpr size_t STORE_BYTES = 4;
+
+/*
+ * Fully-associative buffer of partially written lines. A store merges into
+ * the entry of its line or allocates a new one, pushing out the oldest entry
+ * when the buffer is full. An entry is written out as soon as all its words
+ * are written, or when a read needs the line.
+ */
+class WriteCombiningBuffer {
+    public:
+    struct Entry {
+        uint64_t line = 0;
+        uint64_t mask = 0;  // one bit per written word
+        uint64_t addr = 0;  // last store, sent with the write to memory
+        uint32_t data = 0;
+        bool valid = false;
+        uint64_t age = 0;
+
+        size_t bytes() const { return __builtin_popcountll(mask) * STORE_BYTES; }
+    };
+
+    WriteCombiningBuffer(size_t entries, size_t line_size)
+    : m_entries(entries), m_words(line_size / STORE_BYTES) {}
+
+    bool enabled() const { return !m_entries.empty(); }
+    size_t size() const { return m_entries.size(); }
+
+    // Adds a store. Returns whether an entry has to be written to memory,
+    // either because it is complete or because it made room for this store.
+    bool store(uint64_t addr, uint32_t data, size_t line_size, Entry &out) {
+        uint64_t line = addr / line_size;
+        uint64_t bit = 1ULL << (addr % line_size / STORE_BYTES);
+
+        Entry *slot = nullptr;
+        bool pushed_out = false;
+        for (Entry &e : m_entries) {
+            if (e.valid && e.line == line) {
+                slot = &e;
+                break;
+            }
+        }
+        if (!slot) {
+            slot = &m_entries[0];
+            for (Entry &e : m_entries) {
+                if (!e.valid) {
+                    slot = &e;
+                    break;
+                }
+                if (e.age < slot->age) {
+                    slot = &e;
+                }
+            }
+            if (slot->valid) {
+                out = *slot;
+                pushed_out = true;
+            }
+            *slot = Entry{line, 0, 0, 0, true, ++m_clock};
+        }
+        slot->mask |= bit;
+        slot->addr = addr;
+        slot->data = data;
+
+        if (!pushed_out && slot->mask == full_mask()) {
+            out = *slot;
+            slot->valid = false;
+            return true;
+        }
+        return pushed_out;
+    }
+
+    // Removes the entry of the line, if any, so it can be written out.
+    bool take(uint64_t line, Entry &out) {
+        for (Entry &e : m_entries) {
+            if (e.valid && e.line == line) {
+                out = e;
+                e.valid = false;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Removes the oldest entry, to write out what is left at the end of a
+    // run. Returns false when the buffer is empty.
+    bool take_oldest(Entry &out) {
+        Entry *oldest = nullptr;
+        for (Entry &e : m_entries) {
+            if (e.valid && (!oldest || e.age < oldest->age)) {
+                oldest = &e;
+            }
+        }
+        if (!oldest) {
+            return false;
+        }
+        out = *oldest;
+        oldest->valid = false;
+        return true;
+    }
+
+    void save(CheckpointWriter &out) const {
+        out.write((uint64_t)m_entries.size());
+        out.write(m_clock);
+        for (const Entry &e : m_entries) {
+            out.write(e);
+        }
+    }
+
+    void restore(CheckpointReader &in) {
+        in.expect((uint64_t)m_entries.size(), "the write-combining buffer size");
+        m_clock = in.read<uint64_t>();
+        for (Entry &e : m_entries) {
+            e = in.read<Entry>();
+        }
+    }
+
+    private:
+    std::vector<Entry> m_entries;
+    size_t m_words;
+    uint64_t m_clock = 0;
+
+    uint64_t full_mask() const {
+        return m_words >= 64 ? ~0ULL : (1ULL << m_words) - 1;
+    }
+};
+
+// Bytes moved between the cache and memory, by cause.
+struct MemoryTraffic {
+    uint64_t fills = 0;        // lines read on a miss
+    uint64_t write_backs = 0;  // dirty lines written on eviction
+    uint64_t stores = 0;       // stores sent to memory one by one
+    uint64_t combined = 0;     // writes of the write-combining buffer
+    uint64_t read_bytes = 0;
+    uint64_t write_bytes = 0;
+
+    void print(const std::string &policy, uint64_t accesses) const {
+        using namespace std;
+        uint64_t total = read_bytes + write_bytes;
+        cout << "Memory traffic (" << policy << "):" << endl;
+        cout << "  Read: " << read_bytes << " bytes in " << fills
+             << " line fills" << endl;
+        cout << "  Written: " << write_bytes << " bytes in " << write_backs
+             << " write-backs, " << stores << " single stores and "
+             << combined << " combined writes" << endl;
+        cout << "  Total: " << total << " bytes";
+        if (accesses) {
+            cout << ", " << (double)total / accesses << " bytes per access";
+        }
+        cout << endl;
+    }
+};
+
+#endif
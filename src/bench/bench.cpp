@@ -0,0 +1,193 @@
+/*
+ * File: bench.cpp
+ *
+ * Microbenchmarks of the framework library: decoding a tracefile with
+ * TraceFile::next() and updating the statistics counters, and of the cache of
+ * assignment_1 through its functional interface. Every benchmark
+ * prints one "name value unit" line, which scripts/bench.py collects
+ * together with the end-to-end runs of the simulator.
+ *
+ * Usage: bench.bin <tracefile> [options]
+ */
+
+#include <chrono>
+#include <getopt.h>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "psa.h"
+#include "../assignment_1/cache.h"
+
+using namespace std;
+
+struct Options {
+    unsigned repeat = 5;           // best of this many runs is reported
+    uint64_t stats_updates = 10000000;
+    uint64_t cache_accesses = 1000000;
+};
+
+static void usage(const char *prog) {
+    cerr << "Usage: " << prog << " <tracefile> [options]" << endl
+         << "Options:" << endl
+         << "  -r, --repeat N         runs per benchmark, the fastest counts (default 5)" << endl
+         << "  -s, --stats-updates N  counter updates per run (default 10000000)" << endl
+         << "  -c, --cache-accesses N cache accesses per run (default 1000000)" << endl;
+}
+
+static volatile uint64_t g_sink;
+
+static double seconds_since(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static void report(const char *name, double value, const char *unit) {
+    cout << name << " " << value << " " << unit << endl;
+}
+
+// Reads all entries of all CPUs in the order the simulator does, one entry
+// per CPU in turn, until the whole file is consumed.
+static void bench_trace_next(const char *filename, const Options &opt) {
+    double best = 0.0;
+    uint64_t entries = 0;
+    for (unsigned r = 0; r < opt.repeat; r++) {
+        auto start = chrono::steady_clock::now();
+        TraceFile trace(filename);
+        uint32_t cpus = trace.get_proc_count();
+        TraceFile::Entry e;
+        entries = 0;
+        uint64_t checksum = 0;
+        while (!trace.eof()) {
+            for (uint32_t pid = 0; pid < cpus; pid++) {
+                if (trace.next(pid, e)) {
+                    checksum += e.addr;
+                    entries++;
+                }
+            }
+        }
+        double t = seconds_since(start);
+        if (r == 0 || t < best) {
+            best = t;
+        }
+        // Keep the loop from being optimized away
+        g_sink = checksum;
+    }
+    report("trace_entries", entries, "entries");
+    report("trace_next_ns", 1e9 * best / entries, "ns/entry");
+    report("trace_next_rate", entries / best, "entries/s");
+}
+
+// The hit and miss counters of every CPU, in the mix of a typical run.
+static void bench_stats(const Options &opt) {
+    double best = 0.0;
+    stats_set_enabled(true);
+    for (unsigned r = 0; r < opt.repeat; r++) {
+        auto start = chrono::steady_clock::now();
+        for (uint64_t i = 0; i < opt.stats_updates; i++) {
+            uint32_t cpu = i % num_cpus;
+            switch (i & 7) {
+            case 0: stats_readmiss(cpu); break;
+            case 1: stats_writemiss(cpu); break;
+            case 2: case 3: case 4: stats_readhit(cpu); break;
+            default: stats_writehit(cpu); break;
+            }
+        }
+        double t = seconds_since(start);
+        if (r == 0 || t < best) {
+            best = t;
+        }
+    }
+    report("stats_update_ns", 1e9 * best / opt.stats_updates, "ns/update");
+}
+
+// Replays the reads and writes of the trace through the functional interface
+// of the Cache: tag lookup, replacement and LRU update. The trace is decoded
+// beforehand, so only the cache is timed; every run starts with a cold cache.
+static void bench_cache_access(const char *filename, const Options &opt) {
+    vector<pair<Memory::Function, uint64_t>> accesses;
+    TraceFile trace(filename);
+    uint32_t cpus = trace.get_proc_count();
+    TraceFile::Entry e;
+    while (!trace.eof()) {
+        for (uint32_t pid = 0; pid < cpus; pid++) {
+            if (!trace.next(pid, e)) {
+                continue;
+            }
+            if (e.type == TraceFile::ENTRY_TYPE_READ) {
+                accesses.emplace_back(Memory::FUNC_READ, e.addr);
+            } else if (e.type == TraceFile::ENTRY_TYPE_WRITE) {
+                accesses.emplace_back(Memory::FUNC_WRITE, e.addr);
+            }
+        }
+    }
+    if (accesses.empty()) {
+        throw runtime_error("Error, the trace has no reads or writes");
+    }
+
+    double best = 0.0;
+    for (unsigned r = 0; r < opt.repeat; r++) {
+        Cache cache(("cache" + to_string(r)).c_str());
+        uint64_t hits = 0;
+        auto start = chrono::steady_clock::now();
+        for (uint64_t i = 0; i < opt.cache_accesses; i++) {
+            const auto &a = accesses[i % accesses.size()];
+            hits += cache.functional_access(a.first, a.second, false);
+        }
+        double t = seconds_since(start);
+        if (r == 0 || t < best) {
+            best = t;
+        }
+        g_sink = hits;
+    }
+    report("cache_access_ns", 1e9 * best / opt.cache_accesses, "ns/access");
+}
+
+int sc_main(int argc, char *argv[]) {
+    // The cache logs every access it handles; silence it, so only the
+    // accesses themselves are timed.
+    sc_report_handler::set_verbosity_level(SC_LOW);
+
+    static const option long_options[] = {
+        {"repeat", required_argument, nullptr, 'r'},
+        {"stats-updates", required_argument, nullptr, 's'},
+        {"cache-accesses", required_argument, nullptr, 'c'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}};
+
+    try {
+        // The decode benchmark opens the tracefile itself, so keep its name
+        const char *filename = argc > 1 ? argv[1] : nullptr;
+
+        // Get the tracefile argument, sets tracefile_ptr and num_cpus
+        init_tracefile(&argc, &argv);
+
+        Options opt;
+        int c;
+        while ((c = getopt_long(argc, argv, "r:s:c:h", long_options, nullptr)) != -1) {
+            switch (c) {
+            case 'r': opt.repeat = stoul(optarg); break;
+            case 's': opt.stats_updates = stoull(optarg); break;
+            case 'c': opt.cache_accesses = stoull(optarg); break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            default:
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        if (opt.repeat == 0 || opt.stats_updates == 0 || opt.cache_accesses == 0) {
+            throw runtime_error("Error, repeat, stats updates and cache accesses must be positive");
+        }
+
+        stats_init();
+        bench_trace_next(filename, opt);
+        bench_stats(opt);
+        bench_cache_access(filename, opt);
+    } catch (exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
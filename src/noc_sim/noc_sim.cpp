@@ -0,0 +1,214 @@
+/*
+ * File: noc_sim.cpp
+ *
+ * Drives the 2D mesh network model of lib/noc.h with synthetic traffic.
+ * Every node injects packets with a Bernoulli process at the given rate to
+ * destinations chosen by a traffic pattern. Without --rate the injection rate
+ * is swept upwards until the network saturates, which gives the zero-load
+ * latency and the saturation throughput of the configuration.
+ *
+ * Usage: noc_sim.bin [options]
+ */
+
+#include <getopt.h>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+
+#include "noc.h"
+#include "psa.h"
+
+using namespace std;
+
+enum Pattern { PATTERN_UNIFORM, PATTERN_TRANSPOSE, PATTERN_BITCOMP,
+               PATTERN_NEIGHBOR, PATTERN_HOTSPOT };
+
+struct Options {
+    NocConfig noc;
+    Pattern pattern = PATTERN_UNIFORM;
+    double rate = -1.0;            // packets per node per cycle, <0: sweep
+    unsigned packet_bytes = 40;    // header plus one 32 byte line
+    uint64_t warmup = 1000;        // cycles before measuring
+    uint64_t cycles = 10000;       // measured cycles
+    uint64_t seed = 1;
+};
+
+static Pattern parse_pattern(const string &name) {
+    if (name == "uniform") return PATTERN_UNIFORM;
+    if (name == "transpose") return PATTERN_TRANSPOSE;
+    if (name == "bitcomp") return PATTERN_BITCOMP;
+    if (name == "neighbor") return PATTERN_NEIGHBOR;
+    if (name == "hotspot") return PATTERN_HOTSPOT;
+    throw runtime_error("Error, unknown traffic pattern " + name);
+}
+
+static void usage(const char *prog) {
+    cerr << "Usage: " << prog << " [options]" << endl
+         << "Options:" << endl
+         << "  -m, --mesh WxH         mesh size (default 4x4)" << endl
+         << "  -v, --vcs N            virtual channels per port (default 2)" << endl
+         << "  -b, --buffer N         flits per virtual channel (default 4)" << endl
+         << "  --link-latency N       cycles per link (default 1)" << endl
+         << "  --link-width N         bytes per flit (default 16)" << endl
+         << "  --router-latency N     cycles per router (default 1)" << endl
+         << "  -p, --pattern P        uniform, transpose, bitcomp, neighbor or hotspot" << endl
+         << "  -r, --rate R           packets per node per cycle, sweep if not given" << endl
+         << "  -s, --packet-size N    bytes per packet (default 40)" << endl
+         << "  -w, --warmup N         cycles before measuring (default 1000)" << endl
+         << "  -c, --cycles N         measured cycles (default 10000)" << endl
+         << "  --seed N               random seed" << endl;
+}
+
+static unsigned destination(const Options &opt, unsigned node, mt19937_64 &rng) {
+    unsigned w = opt.noc.width;
+    unsigned h = opt.noc.height;
+    unsigned nodes = w * h;
+    unsigned x = node % w;
+    unsigned y = node / w;
+    switch (opt.pattern) {
+    case PATTERN_TRANSPOSE:
+        return (x % h) * w + (y % w);
+    case PATTERN_BITCOMP:
+        return nodes - 1 - node;
+    case PATTERN_NEIGHBOR:
+        return y * w + (x + 1) % w;
+    case PATTERN_HOTSPOT:
+        // A quarter of the traffic goes to the centre node
+        if (rng() % 4 == 0) {
+            return (h / 2) * w + w / 2;
+        }
+        return rng() % nodes;
+    default:
+        return rng() % nodes;
+    }
+}
+
+// Runs one injection rate, returns the network with the measured results.
+static unique_ptr<Mesh> run(const Options &opt, double rate) {
+    auto mesh = make_unique<Mesh>(opt.noc);
+    mesh->set_measure_window(opt.warmup, opt.warmup + opt.cycles);
+    mt19937_64 rng(opt.seed);
+    bernoulli_distribution inject(min(rate, 1.0));
+    unsigned flits = mesh->flits_for(opt.packet_bytes);
+
+    for (uint64_t c = 0; c < opt.warmup + opt.cycles; c++) {
+        for (unsigned node = 0; node < mesh->nodes(); node++) {
+            if (inject(rng)) {
+                Packet p;
+                p.src = node;
+                p.dst = destination(opt, node, rng);
+                p.flits = flits;
+                mesh->inject(p);
+            }
+        }
+        mesh->step();
+    }
+    // Let the measured packets arrive, bounded in case of saturation
+    for (uint64_t c = 0; c < 10 * opt.cycles && mesh->measured_in_flight(); c++) {
+        mesh->step();
+    }
+    Packet p;
+    for (unsigned node = 0; node < mesh->nodes(); node++) {
+        while (mesh->eject(node, p)) {
+        }
+    }
+    return mesh;
+}
+
+/*
+ * Increases the injection rate until the average latency exceeds three times
+ * the zero-load latency or the network accepts clearly less than offered.
+ * The saturation throughput is the highest accepted throughput seen.
+ */
+static void sweep(const Options &opt) {
+    unsigned flits = Mesh(opt.noc).flits_for(opt.packet_bytes);
+    double step = 0.02 / flits;
+    double zero_load = 0.0;
+    double saturation = 0.0;
+
+    cout << setw(14) << "Offered" << setw(14) << "Accepted" << setw(12)
+         << "Latency" << setw(8) << "p99" << "   (flits/node/cycle, cycles)"
+         << endl;
+    for (double rate = step / 2; rate <= 1.0; rate += step) {
+        auto mesh = run(opt, rate);
+        double latency = mesh->average_latency();
+        if (zero_load == 0.0) {
+            zero_load = latency;
+        }
+        saturation = max(saturation, mesh->accepted_throughput());
+        cout << fixed << setprecision(4) << setw(14) << mesh->offered_throughput()
+             << setw(14) << mesh->accepted_throughput() << setprecision(1)
+             << setw(12) << latency << setw(8) << mesh->latency_percentile(0.99)
+             << defaultfloat << endl;
+        if (latency > 3 * zero_load ||
+            mesh->accepted_throughput() < 0.9 * mesh->offered_throughput()) {
+            break;
+        }
+    }
+    cout << "Zero-load latency: " << setprecision(4) << zero_load << " cycles"
+         << endl;
+    cout << "Saturation throughput: " << saturation << " flits/node/cycle ("
+         << saturation * opt.noc.link_width << " bytes/node/cycle)" << endl;
+}
+
+int sc_main(int argc, char *argv[]) {
+    enum {
+        OPT_LINK_LATENCY = 256, OPT_LINK_WIDTH, OPT_ROUTER_LATENCY, OPT_SEED
+    };
+    static const option long_options[] = {
+        {"mesh", required_argument, nullptr, 'm'},
+        {"vcs", required_argument, nullptr, 'v'},
+        {"buffer", required_argument, nullptr, 'b'},
+        {"link-latency", required_argument, nullptr, OPT_LINK_LATENCY},
+        {"link-width", required_argument, nullptr, OPT_LINK_WIDTH},
+        {"router-latency", required_argument, nullptr, OPT_ROUTER_LATENCY},
+        {"pattern", required_argument, nullptr, 'p'},
+        {"rate", required_argument, nullptr, 'r'},
+        {"packet-size", required_argument, nullptr, 's'},
+        {"warmup", required_argument, nullptr, 'w'},
+        {"cycles", required_argument, nullptr, 'c'},
+        {"seed", required_argument, nullptr, OPT_SEED},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}};
+
+    try {
+        Options opt;
+        opt.noc.width = opt.noc.height = 4;
+        int c;
+        while ((c = getopt_long(argc, argv, "m:v:b:p:r:s:w:c:h", long_options,
+                                nullptr)) != -1) {
+            switch (c) {
+            case 'm': noc_parse_mesh(optarg, opt.noc); break;
+            case 'v': opt.noc.vcs = stoul(optarg); break;
+            case 'b': opt.noc.buffer_depth = stoul(optarg); break;
+            case OPT_LINK_LATENCY: opt.noc.link_latency = stoul(optarg); break;
+            case OPT_LINK_WIDTH: opt.noc.link_width = stoul(optarg); break;
+            case OPT_ROUTER_LATENCY: opt.noc.router_latency = stoul(optarg); break;
+            case 'p': opt.pattern = parse_pattern(optarg); break;
+            case 'r': opt.rate = stod(optarg); break;
+            case 's': opt.packet_bytes = stoul(optarg); break;
+            case 'w': opt.warmup = stoull(optarg); break;
+            case 'c': opt.cycles = stoull(optarg); break;
+            case OPT_SEED: opt.seed = stoull(optarg); break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            default:
+                usage(argv[0]);
+                return 1;
+            }
+        }
+
+        if (opt.rate < 0) {
+            sweep(opt);
+        } else {
+            run(opt, opt.rate)->print_stats(cout);
+        }
+    } catch (exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
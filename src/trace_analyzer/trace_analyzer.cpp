@@ -0,0 +1,501 @@
+/*
+ * File: trace_analyzer.cpp
+ *
+ * Multi-threaded sharing analysis of a tracefile. The trace of every CPU is
+ * analysed independently by a pool of worker threads, each with its own
+ * TraceFile, after which the per-CPU results are merged. The CPU is the unit
+ * of work, so the speedup is bounded by the number of CPUs, and every worker
+ * decodes the whole interleaved file for the entries of its CPU: a trace of
+ * N CPUs is read N times. Reports:
+ *   - per-line sharing: private, read-shared and write-shared lines, split in
+ *     true sharing (a word written by one CPU is accessed by another) and
+ *     false sharing (the CPUs only touch different words of the line)
+ *   - per-CPU footprint and LRU reuse-distance histograms
+ *   - per-barrier-epoch access counts, load imbalance and sharing
+ * Atomics, locks, unlocks and barrier arrivals count as a read and a write of
+ * their lock word or barrier counter.
+ *
+ * Usage: trace_analyzer.bin <tracefile> [options]
+ */
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <getopt.h>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <unordered_map>
+
+#include "psa.h"
+
+using namespace std;
+
+// Sharer sets are kept as bit masks
+static const uint32_t MAX_CPUS = 64;
+static const size_t REUSE_BUCKETS = 40;
+
+struct Options {
+    uint64_t line_size = 32;  // matches CACHE_LINE_SIZE of the simulator
+    uint64_t word_size = 4;
+    unsigned threads = 0;     // 0: one per hardware thread
+    size_t top_lines = 10;    // most shared lines to list
+    bool epochs = true;
+};
+
+// Words of a line read and written by one CPU
+struct LineAccess {
+    uint64_t read_words = 0;
+    uint64_t write_words = 0;
+};
+
+typedef unordered_map<uint64_t, LineAccess> LineMap;
+
+/*
+ * Exact LRU stack distances (number of distinct lines touched since the
+ * previous access to the same line) with a Fenwick tree over access times.
+ * Only the most recent access of every line is marked in the tree; when the
+ * time axis is full the live lines are renumbered, so memory stays
+ * proportional to the footprint instead of the trace length.
+ */
+class ReuseDistance {
+    public:
+    static const uint64_t COLD = UINT64_MAX;
+
+    ReuseDistance() { m_tree.assign(1 << 16, 0); }
+
+    uint64_t access(uint64_t line) {
+        if (m_now + 1 >= m_tree.size()) {
+            compact();
+        }
+        uint64_t distance = COLD;
+        auto it = m_last.find(line);
+        if (it != m_last.end()) {
+            distance = sum(m_now) - sum(it->second + 1);
+            add(it->second + 1, -1);
+            it->second = m_now;
+        } else {
+            m_last.emplace(line, m_now);
+        }
+        add(m_now + 1, 1);
+        m_now++;
+        return distance;
+    }
+
+    private:
+    vector<int32_t> m_tree; // 1-based Fenwick tree over time slots
+    unordered_map<uint64_t, uint64_t> m_last;
+    uint64_t m_now = 0;
+
+    void add(uint64_t i, int32_t v) {
+        for (; i < m_tree.size(); i += i & -i) {
+            m_tree[i] += v;
+        }
+    }
+
+    // Marked slots in [1, i]
+    uint64_t sum(uint64_t i) const {
+        int64_t s = 0;
+        for (; i > 0; i -= i & -i) {
+            s += m_tree[i];
+        }
+        return s;
+    }
+
+    void compact() {
+        vector<pair<uint64_t, uint64_t>> order; // (time, line)
+        order.reserve(m_last.size());
+        for (auto &l : m_last) {
+            order.emplace_back(l.second, l.first);
+        }
+        sort(order.begin(), order.end());
+
+        size_t size = m_tree.size();
+        while (size < 4 * (order.size() + 1)) {
+            size *= 2;
+        }
+        m_tree.assign(size, 0);
+        for (uint64_t t = 0; t < order.size(); t++) {
+            m_last[order[t].second] = t;
+            add(t + 1, 1);
+        }
+        m_now = order.size();
+    }
+};
+
+// Per-epoch counters of one CPU; an epoch ends at every barrier
+struct EpochStats {
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+    unordered_map<uint64_t, bool> lines; // line -> written
+};
+
+struct CpuResult {
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+    uint64_t nops = 0;
+    uint64_t barriers = 0;
+    LineMap lines;
+    array<uint64_t, REUSE_BUCKETS> reuse{};
+    uint64_t cold = 0;
+    vector<EpochStats> epochs;
+};
+
+// Bucket b holds distance 0 for b == 0, otherwise [2^(b-1), 2^b).
+static size_t reuse_bucket(uint64_t d) {
+    size_t b = 0;
+    while (d > 0 && b < REUSE_BUCKETS - 1) {
+        d >>= 1;
+        b++;
+    }
+    return b;
+}
+
+static void analyze_cpu(const char *filename, uint32_t cpu, const Options &opt,
+                        CpuResult &r) {
+    TraceFile trace(filename);
+    TraceFile::Entry e;
+    ReuseDistance reuse;
+    uint64_t words_per_line = opt.line_size / opt.word_size;
+
+    r.epochs.emplace_back();
+    while (trace.next_raw(cpu, e)) {
+        if (e.type == TraceFile::ENTRY_TYPE_NOP) {
+            r.nops++;
+            continue;
+        }
+        // Atomics, locks, unlocks and barrier arrivals are read-modify-writes
+        // of their lock word or barrier counter
+        bool read = e.type != TraceFile::ENTRY_TYPE_WRITE;
+        bool write = e.type != TraceFile::ENTRY_TYPE_READ;
+        uint64_t line = e.addr / opt.line_size;
+        uint64_t word = 1ULL << ((e.addr / opt.word_size) % words_per_line);
+
+        LineAccess &la = r.lines[line];
+        if (read) {
+            la.read_words |= word;
+            r.reads++;
+        }
+        if (write) {
+            la.write_words |= word;
+            r.writes++;
+        }
+
+        uint64_t d = reuse.access(line);
+        if (d == ReuseDistance::COLD) {
+            r.cold++;
+        } else {
+            r.reuse[reuse_bucket(d)]++;
+        }
+
+        if (opt.epochs) {
+            EpochStats &ep = r.epochs.back();
+            ep.reads += read;
+            ep.writes += write;
+            ep.lines[line] |= write;
+        }
+
+        // The arrival at a barrier ends the epoch
+        if (e.type == TraceFile::ENTRY_TYPE_BARRIER) {
+            r.barriers++;
+            r.epochs.emplace_back();
+        }
+    }
+}
+
+// Merged view of one line over all CPUs
+struct SharedLine {
+    uint64_t sharers = 0;     // CPUs that accessed the line
+    uint64_t writers = 0;     // CPUs that wrote the line
+    uint64_t words = 0;       // words accessed by any CPU
+    uint64_t multi_words = 0; // words accessed by more than one CPU
+    uint64_t written_words = 0;
+};
+
+static string sharer_set(uint64_t mask) {
+    string s = "{";
+    for (uint32_t c = 0; c < MAX_CPUS; c++) {
+        if (mask & (1ULL << c)) {
+            s += (s.size() > 1 ? "," : "") + to_string(c);
+        }
+    }
+    return s + "}";
+}
+
+static void report_sharing(const vector<CpuResult> &results, const Options &opt) {
+    unordered_map<uint64_t, SharedLine> merged;
+    for (uint32_t cpu = 0; cpu < results.size(); cpu++) {
+        for (auto &l : results[cpu].lines) {
+            SharedLine &s = merged[l.first];
+            uint64_t words = l.second.read_words | l.second.write_words;
+            s.multi_words |= s.words & words;
+            s.words |= words;
+            s.written_words |= l.second.write_words;
+            s.sharers |= 1ULL << cpu;
+            if (l.second.write_words) {
+                s.writers |= 1ULL << cpu;
+            }
+        }
+    }
+
+    uint64_t priv = 0, read_shared = 0, write_shared = 0, true_shared = 0,
+             false_shared = 0;
+    vector<uint64_t> by_sharers(results.size() + 1, 0);
+    vector<pair<uint64_t, const SharedLine *>> shared;
+    for (auto &l : merged) {
+        const SharedLine &s = l.second;
+        size_t n = bitset<MAX_CPUS>(s.sharers).count();
+        by_sharers[n]++;
+        if (n == 1) {
+            priv++;
+            continue;
+        }
+        shared.emplace_back(l.first, &s);
+        if (!s.writers) {
+            read_shared++;
+        } else {
+            write_shared++;
+            // A written word that is also touched by another CPU means the
+            // CPUs communicate through the line, otherwise the sharing is
+            // only caused by the line granularity.
+            if (s.multi_words & s.written_words) {
+                true_shared++;
+            } else {
+                false_shared++;
+            }
+        }
+    }
+
+    cout << "Sharing at " << opt.line_size << " byte lines, " << opt.word_size
+         << " byte words:" << endl;
+    cout << "  Lines:                " << merged.size() << endl;
+    cout << "  Private:              " << priv << endl;
+    cout << "  Read-shared:          " << read_shared << endl;
+    cout << "  Write-shared:         " << write_shared << endl;
+    cout << "    true sharing:       " << true_shared << endl;
+    cout << "    false sharing:      " << false_shared << endl;
+    cout << "  Lines by number of sharers:" << endl;
+    for (size_t n = 1; n < by_sharers.size(); n++) {
+        if (by_sharers[n]) {
+            cout << setw(8) << n << setw(12) << by_sharers[n] << endl;
+        }
+    }
+
+    // Most widely shared lines, write-shared first
+    size_t top = min(opt.top_lines, shared.size());
+    partial_sort(shared.begin(), shared.begin() + top, shared.end(),
+                 [](const pair<uint64_t, const SharedLine *> &a,
+                    const pair<uint64_t, const SharedLine *> &b) {
+                     size_t na = bitset<MAX_CPUS>(a.second->sharers).count();
+                     size_t nb = bitset<MAX_CPUS>(b.second->sharers).count();
+                     if (na != nb) {
+                         return na > nb;
+                     }
+                     if ((a.second->writers != 0) != (b.second->writers != 0)) {
+                         return a.second->writers != 0;
+                     }
+                     return a.first < b.first;
+                 });
+    if (top > 0) {
+        cout << "  Most shared lines:" << endl;
+        cout << setw(20) << "Address" << setw(8) << "Kind" << "  Sharers / Writers" << endl;
+        for (size_t i = 0; i < top; i++) {
+            const SharedLine &s = *shared[i].second;
+            const char *kind = !s.writers ? "read" :
+                               (s.multi_words & s.written_words) ? "true" : "false";
+            cout << setw(20) << hex << showbase << shared[i].first * opt.line_size
+                 << dec << noshowbase << setw(8) << kind << "  "
+                 << sharer_set(s.sharers) << " / " << sharer_set(s.writers) << endl;
+        }
+    }
+}
+
+static void report_cpus(const vector<CpuResult> &results, const Options &opt) {
+    size_t w = 12;
+    cout << "Per-CPU footprint:" << endl;
+    cout << setw(w) << "CPU" << setw(w) << "Reads" << setw(w) << "Writes"
+         << setw(w) << "NOPs" << setw(w) << "Lines" << setw(w) << "Bytes" << endl;
+    for (size_t cpu = 0; cpu < results.size(); cpu++) {
+        const CpuResult &r = results[cpu];
+        cout << setw(w) << cpu << setw(w) << r.reads << setw(w) << r.writes
+             << setw(w) << r.nops << setw(w) << r.lines.size() << setw(w)
+             << r.lines.size() * opt.line_size << endl;
+    }
+
+    size_t last = 0;
+    for (const CpuResult &r : results) {
+        for (size_t b = 0; b < REUSE_BUCKETS; b++) {
+            if (r.reuse[b]) {
+                last = max(last, b);
+            }
+        }
+    }
+    cout << "Reuse distance histogram (distinct lines between reuses):" << endl;
+    cout << setw(w) << "Distance";
+    for (size_t cpu = 0; cpu < results.size(); cpu++) {
+        cout << setw(w - 2) << "CPU" << setw(2) << cpu;
+    }
+    cout << endl << setw(w) << "cold";
+    for (const CpuResult &r : results) {
+        cout << setw(w) << r.cold;
+    }
+    cout << endl;
+    for (size_t b = 0; b <= last; b++) {
+        string range = b == 0 ? "0" : b == 1 ? "1" :
+                       to_string(1ULL << (b - 1)) + "-" + to_string((1ULL << b) - 1);
+        cout << setw(w) << range;
+        for (const CpuResult &r : results) {
+            cout << setw(w) << r.reuse[b];
+        }
+        cout << endl;
+    }
+}
+
+static void report_epochs(const vector<CpuResult> &results) {
+    size_t num_epochs = 0;
+    bool last_empty = true;
+    for (const CpuResult &r : results) {
+        num_epochs = max(num_epochs, r.epochs.size());
+    }
+    for (const CpuResult &r : results) {
+        if (r.epochs.size() == num_epochs && !r.epochs.back().lines.empty()) {
+            last_empty = false;
+        }
+    }
+    // Traces usually end with a barrier, which leaves an empty last epoch
+    if (num_epochs > 1 && last_empty) {
+        num_epochs--;
+    }
+
+    size_t w = 12;
+    cout << "Per-epoch statistics (epochs are separated by barriers):" << endl;
+    cout << setw(w) << "Epoch" << setw(w) << "Reads" << setw(w) << "Writes"
+         << setw(w) << "MinCPU" << setw(w) << "MaxCPU" << setw(w) << "Lines"
+         << setw(w) << "Shared" << setw(w) << "WShared" << endl;
+    for (size_t e = 0; e < num_epochs; e++) {
+        uint64_t reads = 0, writes = 0, min_acc = UINT64_MAX, max_acc = 0;
+        unordered_map<uint64_t, pair<uint64_t, bool>> lines; // sharers, written
+        for (uint32_t cpu = 0; cpu < results.size(); cpu++) {
+            uint64_t acc = 0;
+            if (e < results[cpu].epochs.size()) {
+                const EpochStats &ep = results[cpu].epochs[e];
+                reads += ep.reads;
+                writes += ep.writes;
+                acc = ep.reads + ep.writes;
+                for (auto &l : ep.lines) {
+                    auto &m = lines[l.first];
+                    m.first |= 1ULL << cpu;
+                    m.second |= l.second;
+                }
+            }
+            min_acc = min(min_acc, acc);
+            max_acc = max(max_acc, acc);
+        }
+        uint64_t shared = 0, wshared = 0;
+        for (auto &l : lines) {
+            if (bitset<MAX_CPUS>(l.second.first).count() > 1) {
+                shared++;
+                wshared += l.second.second;
+            }
+        }
+        cout << setw(w) << e << setw(w) << reads << setw(w) << writes
+             << setw(w) << min_acc << setw(w) << max_acc << setw(w)
+             << lines.size() << setw(w) << shared << setw(w) << wshared << endl;
+    }
+}
+
+static void usage(const char *prog) {
+    cerr << "Usage: " << prog << " <tracefile> [options]" << endl
+         << "  -l, --line-size N    cache line size in bytes (default 32)" << endl
+         << "  -w, --word-size N    word size in bytes (default 4)" << endl
+         << "  -j, --threads N      worker threads, at most one per CPU, each reading the" << endl
+         << "                       whole file (default: hardware threads)" << endl
+         << "  -t, --top N          number of most shared lines to list (default 10)" << endl
+         << "  --no-epochs          skip the per-epoch statistics" << endl;
+}
+
+int sc_main(int argc, char *argv[]) {
+    enum { OPT_NO_EPOCHS = 256 };
+    static const option long_options[] = {
+        {"line-size", required_argument, nullptr, 'l'},
+        {"word-size", required_argument, nullptr, 'w'},
+        {"threads", required_argument, nullptr, 'j'},
+        {"top", required_argument, nullptr, 't'},
+        {"no-epochs", no_argument, nullptr, OPT_NO_EPOCHS},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}};
+
+    try {
+        // Every worker opens the tracefile itself, so keep its name
+        const char *filename = argc > 1 ? argv[1] : nullptr;
+
+        // Get the tracefile argument, sets tracefile_ptr and num_cpus
+        init_tracefile(&argc, &argv);
+
+        Options opt;
+        int c;
+        while ((c = getopt_long(argc, argv, "l:w:j:t:h", long_options, nullptr)) != -1) {
+            switch (c) {
+            case 'l': opt.line_size = stoull(optarg); break;
+            case 'w': opt.word_size = stoull(optarg); break;
+            case 'j': opt.threads = stoul(optarg); break;
+            case 't': opt.top_lines = stoull(optarg); break;
+            case OPT_NO_EPOCHS: opt.epochs = false; break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            default:
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        if (opt.word_size == 0 || opt.line_size % opt.word_size ||
+            opt.line_size / opt.word_size > 64) {
+            throw runtime_error("Error, a line must hold between 1 and 64 words");
+        }
+        if (num_cpus > MAX_CPUS) {
+            throw runtime_error("Error, at most 64 CPUs are supported");
+        }
+
+        unsigned threads = opt.threads ? opt.threads : thread::hardware_concurrency();
+        threads = max(1u, min(threads, num_cpus));
+
+        // Workers take the next unprocessed CPU until all are done
+        vector<CpuResult> results(num_cpus);
+        atomic<uint32_t> next_cpu(0);
+        vector<thread> pool;
+        vector<string> errors(threads);
+        for (unsigned t = 0; t < threads; t++) {
+            pool.emplace_back([&, t]() {
+                try {
+                    for (uint32_t cpu; (cpu = next_cpu++) < num_cpus;) {
+                        analyze_cpu(filename, cpu, opt, results[cpu]);
+                    }
+                } catch (exception &e) {
+                    errors[t] = e.what();
+                }
+            });
+        }
+        for (thread &t : pool) {
+            t.join();
+        }
+        for (const string &e : errors) {
+            if (!e.empty()) {
+                throw runtime_error(e);
+            }
+        }
+
+        cout << "Trace: " << filename << ", " << num_cpus << " CPUs, analysed with "
+             << threads << " threads" << endl;
+        report_sharing(results, opt);
+        report_cpus(results, opt);
+        if (opt.epochs) {
+            report_epochs(results);
+        }
+    } catch (exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
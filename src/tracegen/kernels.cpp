@@ -0,0 +1,435 @@
+/*
+ * File: kernels.cpp
+ *
+ * Implementation of the synthetic workloads of the trace generator.
+ */
+
+#include "kernels.h"
+
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+
+using namespace std;
+
+Emitter::Emitter() : m_finished(false) {
+    m_block.reserve(block_entries);
+}
+
+void Emitter::hand_over() {
+    unique_lock<mutex> lock(m_mutex);
+    m_cond.wait(lock, [this]() { return m_queue.size() < queue_blocks; });
+    m_queue.push_back(std::move(m_block));
+    m_cond.notify_all();
+    lock.unlock();
+
+    m_block = Block();
+    m_block.reserve(block_entries);
+}
+
+void Emitter::finish() {
+    if (!m_block.empty()) {
+        hand_over();
+    }
+    lock_guard<mutex> lock(m_mutex);
+    m_finished = true;
+    m_cond.notify_all();
+}
+
+bool Emitter::pop(Block &block) {
+    unique_lock<mutex> lock(m_mutex);
+    m_cond.wait(lock, [this]() { return !m_queue.empty() || m_finished; });
+    if (m_queue.empty()) {
+        return false;
+    }
+    block = std::move(m_queue.front());
+    m_queue.pop_front();
+    m_cond.notify_all();
+    return true;
+}
+
+// Rounds addr up to a multiple of align (a power of two).
+static uint64_t align_up(uint64_t addr, uint64_t align) {
+    return (addr + align - 1) & ~(align - 1);
+}
+
+// Separation between consecutive arrays, keeps them page aligned
+static const uint64_t ARRAY_ALIGN = 4096;
+
+/*
+ * Zipf distributed ranks in [1, n] using rejection-inversion (Hoermann and
+ * Derflinger), which needs constant memory regardless of n.
+ */
+class ZipfSampler {
+    public:
+    ZipfSampler(uint64_t n, double exponent) : m_n(n), m_e(exponent) {
+        m_h_x1 = h_integral(1.5) - 1.0;
+        m_h_n = h_integral(n + 0.5);
+        m_s = 2.0 - h_integral_inverse(h_integral(2.5) - h(2.0));
+    }
+
+    template <typename Rng>
+    uint64_t operator()(Rng &rng) const {
+        uniform_real_distribution<double> uniform(0.0, 1.0);
+        while (true) {
+            double u = m_h_n + uniform(rng) * (m_h_x1 - m_h_n);
+            double x = h_integral_inverse(u);
+            double k = floor(x + 0.5);
+            if (k < 1) {
+                k = 1;
+            } else if (k > m_n) {
+                k = m_n;
+            }
+            if (k - x <= m_s || u >= h_integral(k + 0.5) - h(k)) {
+                return (uint64_t)k;
+            }
+        }
+    }
+
+    private:
+    double m_n, m_e, m_h_x1, m_h_n, m_s;
+
+    double h(double x) const { return exp(-m_e * log(x)); }
+
+    double h_integral(double x) const {
+        double log_x = log(x);
+        return helper2((1.0 - m_e) * log_x) * log_x;
+    }
+
+    double h_integral_inverse(double x) const {
+        double t = x * (1.0 - m_e);
+        if (t < -1.0) {
+            t = -1.0;
+        }
+        return exp(helper1(t) * x);
+    }
+
+    // log1p(x)/x and expm1(x)/x, well defined around zero
+    static double helper1(double x) {
+        return fabs(x) > 1e-8 ? log1p(x) / x : 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+    }
+    static double helper2(double x) {
+        return fabs(x) > 1e-8 ? expm1(x) / x : 1.0 + x * 0.5 * (1.0 + x * (1.0 / 3.0) * (1.0 + 0.25 * x));
+    }
+};
+
+/*
+ * Strided streams, a[i] = b[i] + s * c[i] over the CPU's part of the arrays.
+ * Every sweep ends with a barrier.
+ */
+class StreamKernel : public Kernel {
+    public:
+    using Kernel::Kernel;
+
+    void run(uint32_t cpu, Emitter &out) const override {
+        uint64_t bytes = align_up(m_p.size * m_p.elem_size, ARRAY_ALIGN);
+        uint64_t a = m_p.base, b = a + bytes, c = b + bytes, sync = c + bytes;
+        uint64_t first, last;
+        partition(m_p.size, cpu, first, last);
+
+        for (uint64_t it = 0; it < m_p.iterations; it++) {
+            for (uint64_t i = first; i < last; i += m_p.stride) {
+                out.read(b + i * m_p.elem_size);
+                out.read(c + i * m_p.elem_size);
+                out.compute(m_p.compute);
+                out.write(a + i * m_p.elem_size);
+            }
+            out.barrier(sync);
+        }
+    }
+};
+
+/*
+ * Uniform or Zipf distributed accesses to one shared array. The popularity
+ * ranks are scattered over the array with a multiplicative permutation so
+ * the hot elements do not share cache lines.
+ */
+class RandomKernel : public Kernel {
+    public:
+    RandomKernel(const KernelParams &p) : Kernel(p), m_zipf(p.size, p.zipf_alpha) {
+        // Odd multiplier near the golden ratio that is coprime with the size
+        m_scatter = (uint64_t)(p.size * 0.6180339887) | 1;
+        while (gcd(m_scatter, p.size) != 1) {
+            m_scatter += 2;
+        }
+    }
+
+    void run(uint32_t cpu, Emitter &out) const override {
+        mt19937_64 rng(m_p.seed * 1000003 + cpu);
+        uniform_int_distribution<uint64_t> uniform(0, m_p.size - 1);
+        bernoulli_distribution is_write(m_p.write_ratio);
+        uint64_t sync = m_p.base + align_up(m_p.size * m_p.elem_size, ARRAY_ALIGN);
+
+        for (uint64_t it = 0; it < m_p.iterations; it++) {
+            for (uint64_t i = 0; i < count(); i++) {
+                uint64_t elem;
+                if (m_p.zipf_alpha > 0.0) {
+                    uint64_t rank = m_zipf(rng) - 1;
+                    elem = (unsigned __int128)rank * m_scatter % m_p.size;
+                } else {
+                    elem = uniform(rng);
+                }
+                uint64_t addr = m_p.base + elem * m_p.elem_size;
+                if (is_write(rng)) {
+                    out.write(addr);
+                } else {
+                    out.read(addr);
+                }
+                out.compute(m_p.compute);
+            }
+            out.barrier(sync);
+        }
+    }
+
+    private:
+    ZipfSampler m_zipf;
+    uint64_t m_scatter;
+};
+
+/*
+ * Pointer chasing through a single random cycle over all nodes, so every
+ * load depends on the previous one. The CPUs start at different nodes of the
+ * same shared list.
+ */
+class ChaseKernel : public Kernel {
+    public:
+    ChaseKernel(const KernelParams &p) : Kernel(p), m_next(p.size) {
+        // Sattolo's algorithm gives a permutation with a single cycle
+        iota(m_next.begin(), m_next.end(), 0);
+        mt19937_64 rng(p.seed);
+        for (uint64_t i = p.size - 1; i > 0; i--) {
+            uniform_int_distribution<uint64_t> pick(0, i - 1);
+            swap(m_next[i], m_next[pick(rng)]);
+        }
+    }
+
+    void run(uint32_t cpu, Emitter &out) const override {
+        uint64_t node = m_p.size * cpu / m_p.procs;
+        uint64_t sync = m_p.base + align_up(m_p.size * m_p.elem_size, ARRAY_ALIGN);
+        for (uint64_t it = 0; it < m_p.iterations; it++) {
+            for (uint64_t i = 0; i < count(); i++) {
+                out.read(m_p.base + node * m_p.elem_size);
+                out.compute(m_p.compute);
+                node = m_next[node];
+            }
+            out.barrier(sync);
+        }
+    }
+
+    private:
+    vector<uint64_t> m_next;
+};
+
+/*
+ * Producer/consumer sharing: every CPU writes its buffer, and after a barrier
+ * reads the buffer of its right neighbour. With false sharing enabled the
+ * buffers are interleaved per element, so the CPUs write different words of
+ * the same lines.
+ */
+class ProdConsKernel : public Kernel {
+    public:
+    using Kernel::Kernel;
+
+    void run(uint32_t cpu, Emitter &out) const override {
+        uint32_t neighbour = (cpu + 1) % m_p.procs;
+        // The barrier counter follows the buffers of all CPUs
+        uint64_t end = m_p.false_sharing ? element(0, m_p.size) : element(m_p.procs, 0);
+        uint64_t sync = align_up(end, ARRAY_ALIGN);
+        for (uint64_t it = 0; it < m_p.iterations; it++) {
+            for (uint64_t i = 0; i < m_p.size; i += m_p.stride) {
+                out.write(element(cpu, i));
+                out.compute(m_p.compute);
+            }
+            out.barrier(sync);
+            for (uint64_t i = 0; i < m_p.size; i += m_p.stride) {
+                out.read(element(neighbour, i));
+                out.compute(m_p.compute);
+            }
+            out.barrier(sync);
+        }
+    }
+
+    private:
+    uint64_t element(uint32_t owner, uint64_t i) const {
+        if (m_p.false_sharing) {
+            return m_p.base + (i * m_p.procs + owner) * m_p.elem_size;
+        }
+        uint64_t bytes = align_up(m_p.size * m_p.elem_size, ARRAY_ALIGN);
+        return m_p.base + owner * bytes + i * m_p.elem_size;
+    }
+};
+
+/*
+ * Blocked matrix multiply C += A * B of order size with block size block.
+ * Block rows of C are distributed round-robin over the CPUs.
+ */
+class MatMulKernel : public Kernel {
+    public:
+    using Kernel::Kernel;
+
+    void run(uint32_t cpu, Emitter &out) const override {
+        uint64_t n = m_p.size, bs = m_p.block;
+        uint64_t bytes = align_up(n * n * m_p.elem_size, ARRAY_ALIGN);
+        uint64_t a = m_p.base, b = a + bytes, c = b + bytes, sync = c + bytes;
+        auto at = [&](uint64_t m, uint64_t i, uint64_t j) {
+            return m + (i * n + j) * m_p.elem_size;
+        };
+
+        for (uint64_t it = 0; it < m_p.iterations; it++) {
+            for (uint64_t ii = bs * cpu; ii < n; ii += bs * m_p.procs) {
+                for (uint64_t jj = 0; jj < n; jj += bs) {
+                    for (uint64_t kk = 0; kk < n; kk += bs) {
+                        for (uint64_t i = ii; i < min(ii + bs, n); i++) {
+                            for (uint64_t j = jj; j < min(jj + bs, n); j++) {
+                                out.read(at(c, i, j));
+                                for (uint64_t k = kk; k < min(kk + bs, n); k++) {
+                                    out.read(at(a, i, k));
+                                    out.read(at(b, k, j));
+                                    out.compute(m_p.compute);
+                                }
+                                out.write(at(c, i, j));
+                            }
+                        }
+                    }
+                }
+            }
+            out.barrier(sync);
+        }
+    }
+};
+
+/*
+ * Iterative radix-2 FFT over size complex points. The butterflies of every
+ * stage are split over the CPUs, with a barrier between the stages.
+ */
+class FftKernel : public Kernel {
+    public:
+    FftKernel(const KernelParams &p) : Kernel(p) {
+        if (p.size < 2 || (p.size & (p.size - 1))) {
+            throw runtime_error("Error, fft size must be a power of two");
+        }
+    }
+
+    void run(uint32_t cpu, Emitter &out) const override {
+        uint64_t n = m_p.size;
+        uint64_t x = m_p.base;
+        uint64_t w = x + align_up(n * m_p.elem_size, ARRAY_ALIGN);
+        uint64_t sync = w + align_up(n / 2 * m_p.elem_size, ARRAY_ALIGN);
+        uint64_t first, last;
+        partition(n / 2, cpu, first, last);
+
+        for (uint64_t it = 0; it < m_p.iterations; it++) {
+            for (uint64_t half = 1; half < n; half *= 2) {
+                for (uint64_t t = first; t < last; t++) {
+                    uint64_t pos = t % half;
+                    uint64_t top = (t / half) * 2 * half + pos;
+                    uint64_t bottom = top + half;
+                    out.read(x + top * m_p.elem_size);
+                    out.read(x + bottom * m_p.elem_size);
+                    out.read(w + pos * (n / (2 * half)) * m_p.elem_size);
+                    out.compute(m_p.compute);
+                    out.write(x + top * m_p.elem_size);
+                    out.write(x + bottom * m_p.elem_size);
+                }
+                out.barrier(sync);
+            }
+        }
+    }
+};
+
+// Distance between locks or counters, so each has a cache line of its own
+static const uint64_t SYNC_STRIDE = 64;
+
+/*
+ * Critical sections: every CPU repeatedly takes one of size locks, chosen at
+ * random, and updates the data the lock protects. The compute NOPs are spent
+ * both inside and after the critical section, so fewer locks and more
+ * compute give more contention.
+ */
+class LockKernel : public Kernel {
+    public:
+    using Kernel::Kernel;
+
+    void run(uint32_t cpu, Emitter &out) const override {
+        mt19937_64 rng(m_p.seed * 1000003 + cpu);
+        uniform_int_distribution<uint64_t> pick(0, m_p.size - 1);
+        uint64_t data = m_p.base + align_up(m_p.size * SYNC_STRIDE, ARRAY_ALIGN);
+        uint64_t sync = data + align_up(m_p.size * SYNC_STRIDE, ARRAY_ALIGN);
+
+        for (uint64_t it = 0; it < m_p.iterations; it++) {
+            for (uint64_t i = 0; i < count(); i++) {
+                uint64_t l = pick(rng);
+                out.lock(m_p.base + l * SYNC_STRIDE);
+                out.read(data + l * SYNC_STRIDE);
+                out.compute(m_p.compute);
+                out.write(data + l * SYNC_STRIDE);
+                out.unlock(m_p.base + l * SYNC_STRIDE);
+                out.compute(m_p.compute);
+            }
+            out.barrier(sync);
+        }
+    }
+};
+
+/*
+ * Shared counters updated with atomic fetch-and-adds, one of size counters
+ * chosen at random every time.
+ */
+class AtomicKernel : public Kernel {
+    public:
+    using Kernel::Kernel;
+
+    void run(uint32_t cpu, Emitter &out) const override {
+        mt19937_64 rng(m_p.seed * 1000003 + cpu);
+        uniform_int_distribution<uint64_t> pick(0, m_p.size - 1);
+        uint64_t sync = m_p.base + align_up(m_p.size * SYNC_STRIDE, ARRAY_ALIGN);
+
+        for (uint64_t it = 0; it < m_p.iterations; it++) {
+            for (uint64_t i = 0; i < count(); i++) {
+                out.atomic(m_p.base + pick(rng) * SYNC_STRIDE);
+                out.compute(m_p.compute);
+            }
+            out.barrier(sync);
+        }
+    }
+};
+
+const vector<pair<string, string>> &kernel_list() {
+    static const vector<pair<string, string>> kernels = {
+        {"stream", "strided streams a[i] = b[i] + s * c[i]"},
+        {"random", "uniform or Zipf (--zipf) random accesses"},
+        {"chase", "pointer chase through one random cycle"},
+        {"prodcons", "producer/consumer sharing between neighbours"},
+        {"matmul", "blocked matrix multiply"},
+        {"fft", "radix-2 FFT butterflies"},
+        {"lock", "critical sections guarded by size locks"},
+        {"atomic", "atomic fetch-and-adds on size counters"},
+    };
+    return kernels;
+}
+
+unique_ptr<Kernel> make_kernel(const string &name, const KernelParams &p) {
+    if (p.procs == 0 || p.size == 0 || p.stride == 0 || p.block == 0 ||
+        p.elem_size == 0) {
+        throw runtime_error("Error, sizes, strides and counts must be positive");
+    }
+    if (name == "stream") {
+        return make_unique<StreamKernel>(p);
+    } else if (name == "random") {
+        return make_unique<RandomKernel>(p);
+    } else if (name == "chase") {
+        return make_unique<ChaseKernel>(p);
+    } else if (name == "prodcons") {
+        return make_unique<ProdConsKernel>(p);
+    } else if (name == "matmul") {
+        return make_unique<MatMulKernel>(p);
+    } else if (name == "fft") {
+        return make_unique<FftKernel>(p);
+    } else if (name == "lock") {
+        return make_unique<LockKernel>(p);
+    } else if (name == "atomic") {
+        return make_unique<AtomicKernel>(p);
+    }
+    throw runtime_error("Error, unknown kernel: " + name);
+}
@@ -0,0 +1,125 @@
+/*
+ * File: kernels.h
+ *
+ * Synthetic multi-core workloads for the native trace generator. Every kernel
+ * describes the memory accesses of one CPU as plain loops that write into an
+ * Emitter. The generator runs the CPUs in parallel and interleaves their
+ * streams into a 5TRF tracefile.
+ *
+ * Every CPU of a kernel must emit the same number of barriers, otherwise the
+ * CPUs that are still running wait forever on the ones that finished. The
+ * barrier counter of a kernel has a page of its own after the kernel's data.
+ */
+
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "psa.h"
+
+// Parameters shared by all kernels, not every kernel uses all of them.
+struct KernelParams {
+    uint32_t procs = 1;        // number of CPUs
+    uint64_t size = 1024;      // problem size (elements, nodes, matrix order, locks or counters)
+    uint64_t count = 0;        // accesses per CPU per iteration (0: size)
+    uint64_t stride = 1;       // stride in elements
+    uint64_t iterations = 1;   // repetitions, separated by barriers
+    uint64_t block = 16;       // block size of the blocked kernels
+    uint64_t elem_size = 8;    // bytes per element
+    uint64_t base = 0x100000;  // address of the first data structure
+    uint64_t compute = 0;      // NOP entries per unit of computation
+    uint64_t seed = 1;         // seed of the pseudo random generators
+    double zipf_alpha = 0.0;   // 0: uniform, otherwise Zipf exponent
+    double write_ratio = 0.0;  // fraction of random accesses that are writes
+    bool false_sharing = false; // interleave the data of the CPUs per word
+};
+
+// Per-CPU output of a kernel. Entries are collected in blocks that are
+// handed to the interleaving writer through a small bounded queue.
+class Emitter {
+    public:
+    static const size_t block_entries = 1 << 15;
+    static const size_t queue_blocks = 4;
+
+    typedef std::vector<uint64_t> Block;
+
+    Emitter();
+
+    void read(uint64_t addr) { push(TraceFile::ENTRY_TYPE_READ, addr); }
+    void write(uint64_t addr) { push(TraceFile::ENTRY_TYPE_WRITE, addr); }
+    // The address of a barrier is that of its counter
+    void barrier(uint64_t addr) { push(TraceFile::ENTRY_TYPE_BARRIER, addr); }
+    void atomic(uint64_t addr) { push(TraceFile::ENTRY_TYPE_ATOMIC, addr); }
+    void lock(uint64_t addr) { push(TraceFile::ENTRY_TYPE_LOCK, addr); }
+    void unlock(uint64_t addr) { push(TraceFile::ENTRY_TYPE_UNLOCK, addr); }
+    void compute(uint64_t cycles) {
+        for (uint64_t i = 0; i < cycles; i++) {
+            push(TraceFile::ENTRY_TYPE_NOP, 0);
+        }
+    }
+
+    // Called by the generator thread once the kernel finished
+    void finish();
+
+    // Called by the writer; returns false when the stream has ended.
+    bool pop(Block &block);
+
+    // Entry layout inside a block: type in the top three bits, as on disk
+    static TraceFile::EntryType type_of(uint64_t v) {
+        return (TraceFile::EntryType)(v >> 61);
+    }
+    static uint64_t addr_of(uint64_t v) { return v & ~(0b111ULL << 61); }
+
+    private:
+    Block m_block;
+    std::deque<Block> m_queue;
+    bool m_finished;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+
+    void push(TraceFile::EntryType type, uint64_t addr) {
+        m_block.push_back(((uint64_t)type << 61) | addr_of(addr));
+        if (m_block.size() == block_entries) {
+            hand_over();
+        }
+    }
+
+    void hand_over();
+};
+
+class Kernel {
+    public:
+    explicit Kernel(const KernelParams &p) : m_p(p) {}
+    virtual ~Kernel() {}
+
+    // Emits the complete trace of one CPU. Runs concurrently for all CPUs,
+    // so implementations may only read shared state.
+    virtual void run(uint32_t cpu, Emitter &out) const = 0;
+
+    protected:
+    KernelParams m_p;
+
+    // Accesses per CPU per iteration
+    uint64_t count() const { return m_p.count ? m_p.count : m_p.size; }
+
+    // Half-open range [first, last) of n items assigned to cpu
+    void partition(uint64_t n, uint32_t cpu, uint64_t &first, uint64_t &last) const {
+        first = n * cpu / m_p.procs;
+        last = n * (cpu + 1) / m_p.procs;
+    }
+};
+
+// Creates the kernel with given name, throws if the name is unknown.
+std::unique_ptr<Kernel> make_kernel(const std::string &name, const KernelParams &p);
+
+// Names and one line descriptions of all kernels, for the usage message.
+const std::vector<std::pair<std::string, std::string>> &kernel_list();
+
+#endif
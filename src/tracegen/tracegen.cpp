@@ -0,0 +1,166 @@
+/*
+ * File: tracegen.cpp
+ *
+ * Native synthetic trace generator. Runs one of the kernels in kernels.h for
+ * every CPU in its own thread and interleaves the per-CPU streams into a
+ * 5TRF tracefile, writing END for a CPU as soon as its stream ends.
+ *
+ * Usage: tracegen.bin <kernel> <output.trf> [options]
+ */
+
+#include <chrono>
+#include <getopt.h>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#include "kernels.h"
+#include "psa.h"
+#include "tracewriter.h"
+
+using namespace std;
+
+static void usage(const char *prog) {
+    cerr << "Usage: " << prog << " <kernel> <output.trf> [options]" << endl
+         << "Kernels:" << endl;
+    for (auto &k : kernel_list()) {
+        cerr << "  " << setw(10) << left << k.first << k.second << endl;
+    }
+    cerr << right
+         << "Options:" << endl
+         << "  -p, --procs N        number of CPUs (default 1)" << endl
+         << "  -n, --size N         elements, nodes, matrix order, FFT points," << endl
+         << "                       locks or counters" << endl
+         << "  -c, --count N        accesses per CPU per iteration (random, chase," << endl
+         << "                       lock, atomic)" << endl
+         << "  -s, --stride N       stride in elements (stream, prodcons)" << endl
+         << "  -i, --iterations N   repetitions, separated by barriers" << endl
+         << "  -b, --block N        block size (matmul)" << endl
+         << "  -e, --elem-size N    bytes per element (default 8)" << endl
+         << "  --base ADDR          address of the first array" << endl
+         << "  --compute N          NOPs per unit of computation" << endl
+         << "  --zipf ALPHA         Zipf exponent (random, default uniform)" << endl
+         << "  --write-ratio F      fraction of writes (random)" << endl
+         << "  --false-sharing      interleave the CPUs' data per element (prodcons)" << endl
+         << "  --seed N             random seed" << endl;
+}
+
+/*
+ * Writes the streams of all CPUs round-robin. After a CPU's stream ended its
+ * END entry is written and its remaining slots are padded with NOPs, which
+ * are never read because TraceFile stops at the END.
+ */
+static void interleave(vector<Emitter> &emitters, TraceWriter &writer) {
+    struct Stream {
+        Emitter::Block block;
+        size_t pos = 0;
+        bool ended = false;
+    };
+    vector<Stream> streams(emitters.size());
+    size_t running = emitters.size();
+
+    while (running > 0) {
+        for (size_t cpu = 0; cpu < streams.size(); cpu++) {
+            Stream &s = streams[cpu];
+            if (!s.ended && s.pos == s.block.size()) {
+                s.pos = 0;
+                if (!emitters[cpu].pop(s.block)) {
+                    s.ended = true;
+                    running--;
+                    writer.write(TraceFile::ENTRY_TYPE_END, 0);
+                    continue;
+                }
+            }
+            if (s.ended) {
+                writer.write(TraceFile::ENTRY_TYPE_NOP, 0);
+            } else {
+                uint64_t v = s.block[s.pos++];
+                writer.write(Emitter::type_of(v), Emitter::addr_of(v));
+            }
+        }
+    }
+}
+
+int sc_main(int argc, char *argv[]) {
+    enum {
+        OPT_BASE = 256, OPT_COMPUTE, OPT_ZIPF, OPT_WRITE_RATIO,
+        OPT_FALSE_SHARING, OPT_SEED
+    };
+    static const option long_options[] = {
+        {"procs", required_argument, nullptr, 'p'},
+        {"size", required_argument, nullptr, 'n'},
+        {"count", required_argument, nullptr, 'c'},
+        {"stride", required_argument, nullptr, 's'},
+        {"iterations", required_argument, nullptr, 'i'},
+        {"block", required_argument, nullptr, 'b'},
+        {"elem-size", required_argument, nullptr, 'e'},
+        {"base", required_argument, nullptr, OPT_BASE},
+        {"compute", required_argument, nullptr, OPT_COMPUTE},
+        {"zipf", required_argument, nullptr, OPT_ZIPF},
+        {"write-ratio", required_argument, nullptr, OPT_WRITE_RATIO},
+        {"false-sharing", no_argument, nullptr, OPT_FALSE_SHARING},
+        {"seed", required_argument, nullptr, OPT_SEED},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}};
+
+    try {
+        KernelParams p;
+        int opt;
+        while ((opt = getopt_long(argc, argv, "p:n:c:s:i:b:e:h", long_options,
+                                  nullptr)) != -1) {
+            switch (opt) {
+            case 'p': p.procs = stoul(optarg); break;
+            case 'n': p.size = stoull(optarg); break;
+            case 'c': p.count = stoull(optarg); break;
+            case 's': p.stride = stoull(optarg); break;
+            case 'i': p.iterations = stoull(optarg); break;
+            case 'b': p.block = stoull(optarg); break;
+            case 'e': p.elem_size = stoull(optarg); break;
+            case OPT_BASE: p.base = stoull(optarg, nullptr, 0); break;
+            case OPT_COMPUTE: p.compute = stoull(optarg); break;
+            case OPT_ZIPF: p.zipf_alpha = stod(optarg); break;
+            case OPT_WRITE_RATIO: p.write_ratio = stod(optarg); break;
+            case OPT_FALSE_SHARING: p.false_sharing = true; break;
+            case OPT_SEED: p.seed = stoull(optarg); break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            default:
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        if (argc - optind != 2) {
+            usage(argv[0]);
+            return 1;
+        }
+
+        unique_ptr<Kernel> kernel = make_kernel(argv[optind], p);
+        TraceWriter writer(argv[optind + 1], p.procs);
+
+        auto start = chrono::steady_clock::now();
+
+        vector<Emitter> emitters(p.procs);
+        vector<thread> threads;
+        for (uint32_t cpu = 0; cpu < p.procs; cpu++) {
+            threads.emplace_back([&, cpu]() {
+                kernel->run(cpu, emitters[cpu]);
+                emitters[cpu].finish();
+            });
+        }
+        interleave(emitters, writer);
+        for (thread &t : threads) {
+            t.join();
+        }
+        writer.close_without_end();
+
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        cout << "Wrote " << writer.count() << " entries for " << p.procs
+             << " CPUs to " << argv[optind + 1] << " in " << elapsed.count()
+             << " s" << endl;
+    } catch (exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -5,16 +5,56 @@
  * Implements a simple CPU and memory simulation with randomly generated
  * read and write requests
  *
+ * The CPU is an open-loop traffic generator: requests arrive at a given
+ * injection rate whether or not the memory keeps up, and up to a number of
+ * them are in flight at once, each tagged with an id that the memory returns
+ * with its response. Every phase of the run injects a fixed number of
+ * requests at one rate and reports the achieved bandwidth and the latency of
+ * the requests, measured from their arrival. Sweeping the rate over several
+ * phases gives the loaded latency versus bandwidth curve of the memory.
+ *
  * Author(s): Michiel W. van Tol, Mike Lankamp, Jony Zhang,
  *            Konstantinos Bousias, Simon Polstra
  */
 
+#include <getopt.h>
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <iomanip>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
 #include <systemc>
+#include <vector>
 
 using namespace std;
 using namespace sc_core; // This pollutes namespace, better: only import what you need.
 
 static const int MEM_SIZE = 512;
+static const int WORD_BYTES = 8;
+
+struct MemoryConfig {
+    unsigned banks = 4;      // banks, interleaved per word
+    unsigned latency = 100;  // cycles from accepting a request to its response
+    unsigned bank_busy = 20; // cycles a bank is occupied by a request
+};
+
+enum AddressPattern { ADDR_UNIFORM, ADDR_SEQUENTIAL, ADDR_ZIPF };
+
+struct TrafficConfig {
+    vector<double> rates{0.05}; // requests per cycle, one phase per rate
+    uint64_t requests = 10000;  // requests per phase
+    double read_fraction = 0.5;
+    AddressPattern pattern = ADDR_UNIFORM;
+    double zipf = 0.99;         // skew of the zipf distribution
+    uint64_t seed = 1;
+    unsigned outstanding = 32;  // requests in flight at once
+    bool histogram = false;     // print the latency histogram of every phase
+};
 
 SC_MODULE(Memory) {
     public:
@@ -25,15 +65,25 @@ SC_MODULE(Memory) {
     sc_in<bool> Port_CLK;
     sc_in<Function> Port_Func;
     sc_in<uint64_t> Port_Addr;
+    sc_in<uint64_t> Port_Id;        // tag of the request
+    sc_in<uint64_t> Port_WriteData;
     sc_out<RetCode> Port_Done;
+    sc_out<uint64_t> Port_DoneId;   // tag of the request that completed
     sc_inout_rv<64> Port_Data;
 
-    SC_CTOR(Memory) {
-        SC_THREAD(execute);
+    SC_HAS_PROCESS(Memory);
+
+    Memory(sc_module_name name, const MemoryConfig &config)
+    : sc_module(name), m_config(config), m_bank_free(config.banks, 0) {
+        SC_THREAD(accept);
+        sensitive << Port_CLK.pos();
+        dont_initialize();
+
+        SC_THREAD(respond);
         sensitive << Port_CLK.pos();
         dont_initialize();
 
-        m_data = new uint64_t[MEM_SIZE];
+        m_data = new uint64_t[MEM_SIZE]();
     }
 
     ~Memory() {
@@ -41,33 +91,74 @@ SC_MODULE(Memory) {
     }
 
     private:
+    struct Request {
+        Function func;
+        uint64_t id;
+        uint64_t data;
+        uint64_t done; // cycle the response is ready
+        uint64_t seq;  // order of arrival, among responses ready together
+
+        bool operator>(const Request &o) const {
+            return done != o.done ? done > o.done : seq > o.seq;
+        }
+    };
+
+    MemoryConfig m_config;
     uint64_t *m_data;
+    uint64_t m_cycle = 0;
+    uint64_t m_seq = 0;
+    vector<uint64_t> m_bank_free; // cycle each bank takes its next request
+    priority_queue<Request, vector<Request>, greater<Request>> m_pending;
 
-    void execute() {
+    // Takes one request per cycle. It starts once its bank is free, which
+    // keeps the bank busy for a while; the data is read or written right
+    // away, so requests see each other in the order they arrived.
+    void accept() {
         while (true) {
             wait(Port_Func.value_changed_event());
 
             Function f = Port_Func.read();
             uint64_t addr = Port_Addr.read();
-            uint64_t data = 0;
-            if (f == FUNC_WRITE) {
-                data = Port_Data.read().to_uint64();
-            }
+            Request r{f, Port_Id.read(), 0, 0, m_seq++};
 
-            // This simulates memory read/write delay
-            wait(100);
+            uint64_t &bank = m_bank_free[addr % m_config.banks];
+            uint64_t start = max(m_cycle, bank);
+            bank = start + m_config.bank_busy;
+            r.done = start + m_config.latency;
 
             if (f == FUNC_READ) {
-                Port_Data.write((addr < MEM_SIZE) ? m_data[addr] : 0);
+                r.data = (addr < MEM_SIZE) ? m_data[addr] : 0;
+            } else if (addr < MEM_SIZE) {
+                m_data[addr] = Port_WriteData.read();
+            }
+            m_pending.push(r);
+        }
+    }
+
+    // Sends at most one response per cycle, oldest first.
+    void respond() {
+        bool driving = false;
+        while (true) {
+            wait();
+            m_cycle++;
+
+            if (m_pending.empty() || m_pending.top().done > m_cycle) {
+                if (driving) {
+                    // Write 64 Z's to float the wire.
+                    Port_Data.write("ZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZ"
+                            "ZZZZZZZZZZZZZZZZZZZZZZZZZZZZZ");
+                    driving = false;
+                }
+                continue;
+            }
+            Request r = m_pending.top();
+            m_pending.pop();
+            Port_DoneId.write(r.id);
+            if (r.func == FUNC_READ) {
+                Port_Data.write(r.data);
+                driving = true;
                 Port_Done.write(RET_READ_DONE);
-                wait();
-                // Write 64 Z's to float the wire.
-                Port_Data.write("ZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZ"
-                        "ZZZZZZZZZZZZZZZZZZZZZZZZZZZZZ");
             } else {
-                if (addr < MEM_SIZE) {
-                    m_data[addr] = data;
-                }
                 Port_Done.write(RET_WRITE_DONE);
             }
         }
@@ -78,56 +169,330 @@ SC_MODULE(CPU) {
     public:
     sc_in<bool> Port_CLK;
     sc_in<Memory::RetCode> Port_MemDone;
+    sc_in<uint64_t> Port_MemDoneId;
     sc_out<Memory::Function> Port_MemFunc;
     sc_out<uint64_t> Port_MemAddr;
+    sc_out<uint64_t> Port_MemId;
+    sc_out<uint64_t> Port_MemWriteData;
     sc_inout_rv<64> Port_MemData;
 
-    SC_CTOR(CPU) {
+    SC_HAS_PROCESS(CPU);
+
+    CPU(sc_module_name name, const TrafficConfig &config)
+    : sc_module(name), m_config(config), m_rng(config.seed),
+      m_in_flight(config.outstanding) {
         SC_THREAD(execute);
         sensitive << Port_CLK.pos();
         dont_initialize();
+
+        SC_THREAD(receive);
+        sensitive << Port_CLK.pos();
+        dont_initialize();
+
+        for (unsigned id = 0; id < config.outstanding; id++) {
+            m_free_ids.push_back(id);
+        }
+        if (config.pattern == ADDR_ZIPF) {
+            // Word k is the k-th most popular one
+            double sum = 0;
+            for (int k = 0; k < MEM_SIZE; k++) {
+                sum += 1.0 / pow(k + 1, config.zipf);
+                m_zipf_cdf.push_back(sum);
+            }
+            for (double &c : m_zipf_cdf) {
+                c /= sum;
+            }
+        }
     }
 
     private:
+    struct Request {
+        Memory::Function func;
+        uint64_t addr;
+        uint64_t data;
+        uint64_t arrival; // cycle the request was generated
+        uint64_t issue;   // cycle it was sent to the memory
+    };
+
+    // Latencies and throughput of one phase
+    struct Phase {
+        double rate;
+        uint64_t start;
+        uint64_t end = 0;      // cycle of the last response
+        vector<uint64_t> latency;
+        uint64_t memory_latency = 0; // summed, from issue to response
+    };
+
+    TrafficConfig m_config;
+    mt19937_64 m_rng;
+    uniform_real_distribution<double> m_uniform{0.0, 1.0};
+    vector<double> m_zipf_cdf;
+    uint64_t m_next_addr = 0;
+    uint64_t m_cycle = 0;
+
+    deque<Request> m_queue;      // arrived, waiting for a free id
+    vector<Request> m_in_flight; // by id
+    vector<uint64_t> m_free_ids;
+    Phase m_phase;
+
+    uint64_t next_address() {
+        switch (m_config.pattern) {
+        case ADDR_SEQUENTIAL:
+            return m_next_addr++ % MEM_SIZE;
+        case ADDR_ZIPF:
+            return upper_bound(m_zipf_cdf.begin(), m_zipf_cdf.end() - 1, m_uniform(m_rng)) -
+                   m_zipf_cdf.begin();
+        default:
+            return m_rng() % MEM_SIZE;
+        }
+    }
+
+    Request next_request() {
+        Request r;
+        r.func = m_uniform(m_rng) < m_config.read_fraction ? Memory::FUNC_READ :
+            Memory::FUNC_WRITE;
+        r.addr = next_address();
+        r.data = m_rng();
+        r.arrival = m_cycle;
+        r.issue = 0;
+        return r;
+    }
+
+    void issue(Request r) {
+        uint64_t id = m_free_ids.back();
+        m_free_ids.pop_back();
+        r.issue = m_cycle;
+        m_in_flight[id] = r;
+
+        Port_MemAddr.write(r.addr);
+        Port_MemId.write(id);
+        if (r.func == Memory::FUNC_WRITE) {
+            Port_MemWriteData.write(r.data);
+        }
+        Port_MemFunc.write(r.func);
+    }
+
+    // Runs every phase until its requests have all completed, one request
+    // arriving per cycle with the probability of the injection rate.
     void execute() {
-        while (true) {
-            Memory::Function f = (rand() % 10) < 5 ? Memory::FUNC_READ :
-                Memory::FUNC_WRITE;
-            uint64_t addr = rand() % MEM_SIZE;
-            uint64_t data;
+        print_header();
+        for (double rate : m_config.rates) {
+            m_phase = Phase();
+            m_phase.rate = rate;
+            m_phase.start = m_cycle;
 
-            Port_MemAddr.write(addr);
-            Port_MemFunc.write(f);
+            uint64_t generated = 0;
+            while (generated < m_config.requests || !m_queue.empty() ||
+                   m_free_ids.size() < m_config.outstanding) {
+                if (generated < m_config.requests && m_uniform(m_rng) < rate) {
+                    m_queue.push_back(next_request());
+                    generated++;
+                }
+                if (!m_queue.empty() && !m_free_ids.empty()) {
+                    issue(m_queue.front());
+                    m_queue.pop_front();
+                }
 
-            if (f == Memory::FUNC_WRITE) {
-                data = rand();
-                Port_MemData.write(data);
+                // Advance one cycle in simulated time
                 wait();
-                Port_MemData.write("ZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZZ");
+                m_cycle++;
             }
+            print_phase();
+        }
+        sc_stop();
+    }
 
+    void receive() {
+        while (true) {
             wait(Port_MemDone.value_changed_event());
 
-            if (f == Memory::FUNC_READ) {
-                data = Port_MemData.read().to_uint64();
+            uint64_t id = Port_MemDoneId.read();
+            const Request &r = m_in_flight[id];
+            if (Port_MemDone.read() == Memory::RET_READ_DONE) {
+                // Read the data off the bus like a real CPU would
+                Port_MemData.read().to_uint64();
             }
+            m_phase.latency.push_back(m_cycle - r.arrival);
+            m_phase.memory_latency += m_cycle - r.issue;
+            m_phase.end = m_cycle;
+            m_free_ids.push_back(id);
+        }
+    }
 
-            // Advance one cycle in simulated time
-            wait();
+    void print_header() const {
+        const char *patterns[] = {"uniform", "sequential", "zipf"};
+        cout << "Traffic: " << m_config.requests << " requests per rate, "
+             << 100 * m_config.read_fraction << "% reads, " << patterns[m_config.pattern]
+             << " addresses, " << m_config.outstanding << " outstanding, seed "
+             << m_config.seed << endl;
+        cout << setw(10) << "Offered" << setw(10) << "Achieved" << setw(13)
+             << "Bytes/cycle" << setw(10) << "Latency" << setw(10) << "Memory"
+             << setw(8) << "P50" << setw(8) << "P95" << setw(8) << "P99" << setw(8)
+             << "Max" << endl;
+    }
+
+    void print_phase() {
+        vector<uint64_t> &lat = m_phase.latency;
+        sort(lat.begin(), lat.end());
+        uint64_t n = lat.size();
+        uint64_t cycles = m_phase.end > m_phase.start ? m_phase.end - m_phase.start : 1;
+        double achieved = (double)n / cycles;
+        uint64_t total = 0;
+        for (uint64_t l : lat) {
+            total += l;
+        }
+        auto percentile = [&](double p) {
+            return n ? lat[min<uint64_t>(n - 1, (uint64_t)(p * n))] : 0;
+        };
+
+        cout << fixed << setprecision(4) << setw(10) << m_phase.rate << setw(10)
+             << achieved << setprecision(2) << setw(13) << achieved * WORD_BYTES
+             << setw(10) << (n ? (double)total / n : 0.0) << setw(10)
+             << (n ? (double)m_phase.memory_latency / n : 0.0) << setw(8)
+             << percentile(0.50) << setw(8) << percentile(0.95) << setw(8)
+             << percentile(0.99) << setw(8) << (n ? lat.back() : 0) << endl;
+        cout.unsetf(ios::floatfield);
+
+        if (m_config.histogram) {
+            print_histogram();
+        }
+    }
+
+    // Power of two buckets of the latencies of the phase
+    void print_histogram() const {
+        vector<uint64_t> buckets;
+        for (uint64_t l : m_phase.latency) {
+            size_t b = 0;
+            while ((2ull << b) <= l) {
+                b++;
+            }
+            if (b >= buckets.size()) {
+                buckets.resize(b + 1, 0);
+            }
+            buckets[b]++;
+        }
+        uint64_t most = buckets.empty() ? 0 : *max_element(buckets.begin(), buckets.end());
+        size_t first = 0;
+        while (first < buckets.size() && buckets[first] == 0) {
+            first++;
+        }
+        for (size_t b = first; b < buckets.size(); b++) {
+            ostringstream range;
+            range << (b ? 1ull << b : 0) << "-" << (2ull << b) - 1;
+            cout << setw(20) << range.str() << setw(10) << buckets[b] << " "
+                 << string(most ? buckets[b] * 50 / most : 0, '#') << endl;
         }
     }
 };
 
+// Parses a comma separated list of numbers.
+static vector<double> parse_rates(const char *arg) {
+    vector<double> rates;
+    stringstream s(arg);
+    string item;
+    while (getline(s, item, ',')) {
+        rates.push_back(stod(item));
+    }
+    return rates;
+}
+
+static AddressPattern parse_pattern(const string &name) {
+    if (name == "uniform") return ADDR_UNIFORM;
+    if (name == "sequential") return ADDR_SEQUENTIAL;
+    if (name == "zipf") return ADDR_ZIPF;
+    throw runtime_error("Error, unknown address pattern " + name);
+}
+
+static void usage(const char *prog) {
+    cerr << "Usage: " << prog << " [options]" << endl
+         << "  --rate L             injection rates in requests per cycle, one phase" << endl
+         << "                       each, e.g. 0.02,0.05,0.1,0.15,0.2 (default 0.05)" << endl
+         << "  --requests N         requests per phase (default 10000)" << endl
+         << "  --read-fraction F    share of reads (default 0.5)" << endl
+         << "  --pattern P          addresses: uniform, sequential or zipf (default uniform)" << endl
+         << "  --zipf S             skew of the zipf pattern (default 0.99)" << endl
+         << "  --seed N             random seed (default 1)" << endl
+         << "  --outstanding N      requests in flight at once (default 32)" << endl
+         << "  --histogram          print the latency histogram of every phase" << endl
+         << "  --banks N            memory banks (default 4)" << endl
+         << "  --mem-latency N      memory latency in cycles (default 100)" << endl
+         << "  --bank-busy N        cycles a bank is busy per request (default 20)" << endl;
+}
+
+static void parse_options(int argc, char *argv[], TrafficConfig &traffic, MemoryConfig &memory) {
+    enum {
+        OPT_RATE = 256, OPT_REQUESTS, OPT_READ_FRACTION, OPT_PATTERN, OPT_ZIPF,
+        OPT_SEED, OPT_OUTSTANDING, OPT_HISTOGRAM, OPT_BANKS, OPT_MEM_LATENCY,
+        OPT_BANK_BUSY
+    };
+    static const option long_options[] = {
+        {"rate", required_argument, nullptr, OPT_RATE},
+        {"requests", required_argument, nullptr, OPT_REQUESTS},
+        {"read-fraction", required_argument, nullptr, OPT_READ_FRACTION},
+        {"pattern", required_argument, nullptr, OPT_PATTERN},
+        {"zipf", required_argument, nullptr, OPT_ZIPF},
+        {"seed", required_argument, nullptr, OPT_SEED},
+        {"outstanding", required_argument, nullptr, OPT_OUTSTANDING},
+        {"histogram", no_argument, nullptr, OPT_HISTOGRAM},
+        {"banks", required_argument, nullptr, OPT_BANKS},
+        {"mem-latency", required_argument, nullptr, OPT_MEM_LATENCY},
+        {"bank-busy", required_argument, nullptr, OPT_BANK_BUSY},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}};
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, nullptr)) != -1) {
+        switch (opt) {
+        case OPT_RATE: traffic.rates = parse_rates(optarg); break;
+        case OPT_REQUESTS: traffic.requests = stoull(optarg); break;
+        case OPT_READ_FRACTION: traffic.read_fraction = stod(optarg); break;
+        case OPT_PATTERN: traffic.pattern = parse_pattern(optarg); break;
+        case OPT_ZIPF: traffic.zipf = stod(optarg); break;
+        case OPT_SEED: traffic.seed = stoull(optarg); break;
+        case OPT_OUTSTANDING: traffic.outstanding = stoul(optarg); break;
+        case OPT_HISTOGRAM: traffic.histogram = true; break;
+        case OPT_BANKS: memory.banks = stoul(optarg); break;
+        case OPT_MEM_LATENCY: memory.latency = stoul(optarg); break;
+        case OPT_BANK_BUSY: memory.bank_busy = stoul(optarg); break;
+        case 'h':
+            usage(argv[0]);
+            exit(0);
+        default:
+            usage(argv[0]);
+            throw runtime_error("Error, invalid arguments");
+        }
+    }
+
+    for (double rate : traffic.rates) {
+        if (rate <= 0 || rate > 1) {
+            throw runtime_error("Error, injection rates must be above 0 and at most 1");
+        }
+    }
+    if (traffic.rates.empty() || traffic.requests == 0 || traffic.outstanding == 0) {
+        throw runtime_error("Error, need a rate, requests and outstanding requests");
+    }
+    if (memory.banks == 0 || memory.latency == 0) {
+        throw runtime_error("Error, the memory needs banks and a latency");
+    }
+}
+
 int sc_main(int argc, char *argv[]) {
     try {
+        TrafficConfig traffic;
+        MemoryConfig memory;
+        parse_options(argc, argv, traffic, memory);
+
         // Instantiate Modules
-        Memory mem("main_memory");
-        CPU    cpu("cpu");
+        Memory mem("main_memory", memory);
+        CPU    cpu("cpu", traffic);
 
         // Buffers and Signals
         sc_buffer<Memory::Function> sigMemFunc;
         sc_buffer<Memory::RetCode>  sigMemDone;
         sc_signal<uint64_t>         sigMemAddr;
+        sc_signal<uint64_t>         sigMemId;
+        sc_signal<uint64_t>         sigMemWriteData;
+        sc_signal<uint64_t>         sigMemDoneId;
         sc_signal_rv<64>            sigMemData;
 
         // The clock that will drive the CPU and Memory
@@ -136,20 +501,26 @@ int sc_main(int argc, char *argv[]) {
         // Connecting module ports with signals
         mem.Port_Func(sigMemFunc);
         mem.Port_Addr(sigMemAddr);
+        mem.Port_Id(sigMemId);
+        mem.Port_WriteData(sigMemWriteData);
         mem.Port_Data(sigMemData);
         mem.Port_Done(sigMemDone);
+        mem.Port_DoneId(sigMemDoneId);
 
         cpu.Port_MemFunc(sigMemFunc);
         cpu.Port_MemAddr(sigMemAddr);
+        cpu.Port_MemId(sigMemId);
+        cpu.Port_MemWriteData(sigMemWriteData);
         cpu.Port_MemData(sigMemData);
         cpu.Port_MemDone(sigMemDone);
+        cpu.Port_MemDoneId(sigMemDoneId);
 
         mem.Port_CLK(clk);
         cpu.Port_CLK(clk);
 
         cout << "Running (press CTRL+C to exit)... " << endl;
 
-        // Start Simulation
+        // Start Simulation, the CPU stops it after the last phase
         sc_start();
     } catch (exception& e) {
         cerr << e.what() << endl;